@@ -0,0 +1,256 @@
+
+//
+// Storing and comparing benchmark results
+//
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <cstdlib>
+#include <cctype>
+#include "benchmark.h"
+
+
+using namespace std;
+
+
+static string jsonString(const string& text) {
+
+	ostringstream out;
+	out << '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\') out << '\\' << c;
+		else if ((unsigned char)c < 0x20) out << "\\u" << hex << setw(4) << setfill('0') << (int)c << dec;
+		else out << c;
+	}
+	out << '"';
+	return out.str();
+}
+
+
+bool writeBenchmarkJson(const char* fileName, const vector<pair<string, string>>& machine, const vector<BenchmarkResult>& results) {
+
+	ofstream file(fileName);
+	if (!file.is_open()) {
+		cout << "Cannot create file " << fileName << endl;
+		return false;
+	}
+	file << setprecision(9);
+	file << "{\n\"machine\": {";
+	for (size_t m = 0; m < machine.size(); m++) {
+		file << (m ? ", " : "") << jsonString(machine[m].first) << ": " << jsonString(machine[m].second);
+	}
+	file << "},\n\"results\": [\n";
+	for (size_t r = 0; r < results.size(); r++) {
+		const BenchmarkResult& result = results[r];
+		file << "{\"generator\": " << jsonString(result.generator) << ", \"C\": " << jsonString(result.C)
+			<< ", \"size\": " << result.size << ", \"max_iterations\": " << result.max_iterations
+			<< ", \"warmup\": " << result.warmup << ", \"repetitions\": " << result.repetitions
+			<< ", \"min_s\": " << result.minSec << ", \"median_s\": " << result.medianSec << ", \"p90_s\": " << result.p90Sec
+			<< ", \"max_s\": " << result.maxSec << ", \"mean_s\": " << result.meanSec << ", \"io_s\": " << result.ioSec << ", \"io_parallel_s\": " << result.parallelIoSec
+			<< ", \"pixels_per_s\": " << result.pixelsPerSec << ", \"iterations_per_s\": " << result.iterationsPerSec << "}"
+			<< (r + 1 < results.size() ? ",\n" : "\n");
+	}
+	file << "]\n}\n";
+	return file.good();
+}
+
+
+// Just enough of a JSON parser for the files of writeBenchmarkJson: the results are objects of strings and numbers, anything else is skipped
+class JsonReader {
+public:
+	JsonReader(const string& text) : text(text), pos(0) {}
+
+	bool readResults(vector<BenchmarkResult>& results) {
+		if (!accept('{')) return false;
+		if (accept('}')) return true;
+		do {
+			string key;
+			if (!readString(key) || !accept(':')) return false;
+			if (key == "results") {
+				if (!readResultArray(results)) return false;
+			}
+			else if (!skipValue()) return false;
+		} while (accept(','));
+		return accept('}');
+	}
+
+private:
+	const string& text;
+	size_t pos;
+
+	char peek() {
+		while (pos < text.size() && isspace((unsigned char)text[pos])) pos++;
+		return pos < text.size() ? text[pos] : '\0';
+	}
+	bool accept(char c) {
+		if (peek() != c) return false;
+		pos++;
+		return true;
+	}
+
+	bool readString(string& value) {
+		if (!accept('"')) return false;
+		value.clear();
+		while (pos < text.size() && text[pos] != '"') {
+			char c = text[pos++];
+			if (c == '\\' && pos < text.size()) {
+				c = text[pos++];
+				if (c == 'u') {
+					if (pos + 4 > text.size()) return false;
+					c = (char)strtol(text.substr(pos, 4).c_str(), nullptr, 16);
+					pos += 4;
+				}
+				else if (c == 'n') c = '\n';
+				else if (c == 't') c = '\t';
+			}
+			value += c;
+		}
+		return accept('"');
+	}
+
+	// A number, true, false or null, as its text
+	bool readLiteral(string& value) {
+		peek();
+		size_t start = pos;
+		while (pos < text.size() && (isalnum((unsigned char)text[pos]) || text[pos] == '-' || text[pos] == '+' || text[pos] == '.')) pos++;
+		value = text.substr(start, pos - start);
+		return !value.empty();
+	}
+
+	bool skipValue() {
+		string ignored;
+		char c = peek();
+		if (c == '"') return readString(ignored);
+		if (c == '{' || c == '[') {
+			const char close = c == '{' ? '}' : ']';
+			pos++;
+			if (accept(close)) return true;
+			do {
+				if (c == '{' && (!readString(ignored) || !accept(':'))) return false;
+				if (!skipValue()) return false;
+			} while (accept(','));
+			return accept(close);
+		}
+		return readLiteral(ignored);
+	}
+
+	bool readResultArray(vector<BenchmarkResult>& results) {
+		if (!accept('[')) return false;
+		if (accept(']')) return true;
+		do {
+			map<string, string> fields;
+			if (!accept('{')) return false;
+			if (!accept('}')) {
+				do {
+					string key, value;
+					if (!readString(key) || !accept(':')) return false;
+					if (peek() == '"' ? !readString(value) : !readLiteral(value)) return false;
+					fields[key] = value;
+				} while (accept(','));
+				if (!accept('}')) return false;
+			}
+			results.push_back(toResult(fields));
+		} while (accept(','));
+		return accept(']');
+	}
+
+	static BenchmarkResult toResult(map<string, string>& fields) {
+		BenchmarkResult result;
+		result.generator = fields["generator"];
+		result.C = fields["C"];
+		result.size = (unsigned int)strtoul(fields["size"].c_str(), nullptr, 10);
+		result.max_iterations = (unsigned int)strtoul(fields["max_iterations"].c_str(), nullptr, 10);
+		result.warmup = (unsigned int)strtoul(fields["warmup"].c_str(), nullptr, 10);
+		result.repetitions = (unsigned int)strtoul(fields["repetitions"].c_str(), nullptr, 10);
+		result.minSec = number(fields, "min_s");
+		result.medianSec = number(fields, "median_s");
+		result.p90Sec = number(fields, "p90_s");
+		result.maxSec = number(fields, "max_s");
+		result.meanSec = number(fields, "mean_s");
+		result.ioSec = number(fields, "io_s");
+		result.parallelIoSec = number(fields, "io_parallel_s");
+		result.pixelsPerSec = number(fields, "pixels_per_s");
+		result.iterationsPerSec = number(fields, "iterations_per_s");
+		return result;
+	}
+
+	// -1 for a missing field, like a measurement that was not taken
+	static double number(map<string, string>& fields, const char* key) {
+		map<string, string>::const_iterator field = fields.find(key);
+		return field == fields.end() ? -1.0 : strtod(field->second.c_str(), nullptr);
+	}
+};
+
+
+bool readBenchmarkJson(const char* fileName, vector<BenchmarkResult>& results) {
+
+	ifstream file(fileName);
+	if (!file.is_open()) {
+		cout << "Cannot open file " << fileName << endl;
+		return false;
+	}
+	ostringstream text;
+	text << file.rdbuf();
+	results.clear();
+	if (!JsonReader(text.str()).readResults(results)) {
+		cout << fileName << " is not a benchmark results file\n";
+		return false;
+	}
+	return true;
+}
+
+
+// Identifies the same case in two result files
+static string caseKey(const BenchmarkResult& result) {
+
+	ostringstream key;
+	key << result.generator << " C=" << result.C << " size=" << result.size << " mIterations=" << result.max_iterations;
+	return key.str();
+}
+
+
+size_t compareBenchmarks(const vector<BenchmarkResult>& baseline, const vector<BenchmarkResult>& current, const double tolerance, ostream& out) {
+
+	map<string, const BenchmarkResult*> baselineCases;
+	for (const BenchmarkResult& result : baseline) {
+		baselineCases[caseKey(result)] = &result;
+	}
+
+	size_t regressions = 0, improvements = 0, compared = 0;
+	out << fixed << setprecision(6);
+	for (const BenchmarkResult& result : current) {
+		const string key = caseKey(result);
+		map<string, const BenchmarkResult*>::iterator before = baselineCases.find(key);
+		if (before == baselineCases.end()) {
+			out << "new       " << key << ": " << result.medianSec << " s\n";
+			continue;
+		}
+		const double baseSec = before->second->medianSec;
+		baselineCases.erase(before);
+		if (baseSec <= 0.0 || result.medianSec <= 0.0) continue;
+		compared++;
+
+		const double change = result.medianSec / baseSec - 1.0;
+		const char* verdict = "same      ";
+		if (change > tolerance) {
+			verdict = "REGRESSION";
+			regressions++;
+		}
+		else if (change < -tolerance) {
+			verdict = "faster    ";
+			improvements++;
+		}
+		out << verdict << " " << key << ": " << baseSec << " s -> " << result.medianSec << " s ("
+			<< showpos << setprecision(1) << 100.0 * change << noshowpos << setprecision(6) << "%)\n";
+	}
+	for (const pair<const string, const BenchmarkResult*>& missing : baselineCases) {
+		out << "missing   " << missing.first << "\n";
+	}
+	out << defaultfloat << compared << " cases compared, " << regressions << " slower and " << improvements << " faster than "
+		<< 100.0 * tolerance << "% tolerance\n";
+	return regressions;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <ostream>
+
+// Measurements of one case of the benchmark grid: one generator rendering one size, max_iterations and C.
+// Times are compute times in seconds, without saving the image; ioSec is the time of saving one PNG with fipImage::save and parallelIoSec
+// with writePngParallel, -1 when not measured
+struct BenchmarkResult {
+	std::string generator, C;
+	unsigned int size, max_iterations;
+	unsigned int warmup, repetitions;
+	double minSec, medianSec, p90Sec, maxSec, meanSec;
+	double ioSec, parallelIoSec;
+	// size * size / medianSec, and the iterations of the plain escape time algorithm (the escape counts) / medianSec
+	double pixelsPerSec, iterationsPerSec;
+};
+
+// Writes the results as JSON: { "machine": { key: value, ... }, "results": [ { ... }, ... ] }, one result per line.
+// Returns false when the file could not be written
+bool writeBenchmarkJson(const char* fileName, const std::vector<std::pair<std::string, std::string>>& machine, const std::vector<BenchmarkResult>& results);
+
+// Reads the results of a file written by writeBenchmarkJson. Returns false when the file could not be read or parsed
+bool readBenchmarkJson(const char* fileName, std::vector<BenchmarkResult>& results);
+
+// Compares the median times of the cases found in both lists and prints a table to out. A case is a regression when its median
+// is more than tolerance (a fraction) slower than in baseline. Returns the number of regressions
+size_t compareBenchmarks(const std::vector<BenchmarkResult>& baseline, const std::vector<BenchmarkResult>& current, const double tolerance, std::ostream& out);
@@ -0,0 +1,129 @@
+
+//
+// Double-double arithmetic for the reference orbit of the deep zoom
+//
+
+
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include "double_double.h"
+
+
+using namespace std;
+
+
+// a + b exactly, as the rounded sum and its rounding error
+static DoubleDouble twoSum(double a, double b) {
+
+	double s = a + b;
+	double v = s - a;
+	double e = (a - (s - v)) + (b - v);
+	return DoubleDouble(s, e);
+}
+
+// twoSum for |a| >= |b|
+static DoubleDouble quickTwoSum(double a, double b) {
+
+	double s = a + b;
+	return DoubleDouble(s, b - (s - a));
+}
+
+// a * b exactly: fma computes the rounding error of the product without rounding it
+static DoubleDouble twoProduct(double a, double b) {
+
+	double p = a * b;
+	return DoubleDouble(p, fma(a, b, -p));
+}
+
+
+DoubleDouble operator+(const DoubleDouble& a, const DoubleDouble& b) {
+
+	DoubleDouble s = twoSum(a.hi, b.hi);
+	DoubleDouble t = twoSum(a.lo, b.lo);
+	s.lo += t.hi;
+	s = quickTwoSum(s.hi, s.lo);
+	s.lo += t.lo;
+	return quickTwoSum(s.hi, s.lo);
+}
+
+
+DoubleDouble operator-(const DoubleDouble& a) {
+
+	return DoubleDouble(-a.hi, -a.lo);
+}
+
+
+DoubleDouble operator-(const DoubleDouble& a, const DoubleDouble& b) {
+
+	return a + -b;
+}
+
+
+DoubleDouble operator*(const DoubleDouble& a, const DoubleDouble& b) {
+
+	DoubleDouble p = twoProduct(a.hi, b.hi);
+	p.lo += a.hi * b.lo + a.lo * b.hi;
+	return quickTwoSum(p.hi, p.lo);
+}
+
+
+DoubleDouble operator/(const DoubleDouble& a, const DoubleDouble& b) {
+
+	// Long division: the first quotient digit in double, then a correction from the remainder
+	double q1 = a.hi / b.hi;
+	DoubleDouble r = a - b * DoubleDouble(q1);
+	double q2 = r.hi / b.hi;
+	r = r - b * DoubleDouble(q2);
+	double q3 = r.hi / b.hi;
+	return quickTwoSum(q1, q2) + DoubleDouble(q3);
+}
+
+
+bool parseDoubleDouble(const char* text, DoubleDouble& value) {
+
+	// Largest exponent accepted; far beyond the range of double, it only keeps the scaling loop short
+	const long maxExponent = 1000;
+	const char* c = text;
+	while (isspace((unsigned char)*c)) c++;
+	bool negative = *c == '-';
+	if (*c == '-' || *c == '+') c++;
+
+	// All digits form one integer mantissa, scaled by a power of ten afterwards
+	DoubleDouble mantissa(0.0);
+	int exponent = 0, digits = 0;
+	bool point = false;
+	for (; isdigit((unsigned char)*c) || (*c == '.' && !point); c++) {
+		if (*c == '.') {
+			point = true;
+			continue;
+		}
+		mantissa = mantissa * DoubleDouble(10.0) + DoubleDouble(*c - '0');
+		digits++;
+		if (point) exponent--;
+	}
+	if (digits == 0) return false;
+
+	if (*c == 'e' || *c == 'E') {
+		char* end;
+		long e = strtol(c + 1, &end, 10);
+		if (end == c + 1 || e < -maxExponent || e > maxExponent) return false;
+		exponent += (int)e;
+		c = end;
+	}
+	while (isspace((unsigned char)*c)) c++;
+	if (*c != '\0') return false;
+
+	if (mantissa.hi == 0.0) {
+		value = DoubleDouble(0.0);
+		return true;
+	}
+	DoubleDouble scale(1.0);
+	for (int i = 0; i < abs(exponent); i++) {
+		scale = scale * DoubleDouble(10.0);
+	}
+	value = exponent < 0 ? mantissa / scale : mantissa * scale;
+	if (negative) value = -value;
+	// Overflow to infinity, or underflow of a number that is not 0
+	return isfinite(value.hi) && (value.hi != 0.0 || mantissa.hi == 0.0);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// Unevaluated sum hi + lo of two doubles with |lo| <= half an ulp of hi: about 32 significant digits, with the exponent range of double.
+// Enough for the reference orbit of a deep zoom down to a scale of about 1e-28, without an arbitrary precision library.
+struct DoubleDouble {
+
+	double hi, lo;
+
+	DoubleDouble(double value = 0.0) : hi(value), lo(0.0) {};
+	DoubleDouble(double hi, double lo) : hi(hi), lo(lo) {};
+};
+
+DoubleDouble operator+(const DoubleDouble& a, const DoubleDouble& b);
+DoubleDouble operator-(const DoubleDouble& a, const DoubleDouble& b);
+DoubleDouble operator-(const DoubleDouble& a);
+DoubleDouble operator*(const DoubleDouble& a, const DoubleDouble& b);
+DoubleDouble operator/(const DoubleDouble& a, const DoubleDouble& b);
+
+// Nearest double
+inline double toDouble(const DoubleDouble& a) {
+	return a.hi + a.lo;
+}
+
+// Parses a decimal number like "-1.25", "0.000314" or "3.14e-4" with all of its digits, where a double would keep only 17 of them.
+// Returns false when text is not a number, or when its value overflows or underflows a double
+bool parseDoubleDouble(const char* text, DoubleDouble& value);
@@ -0,0 +1,115 @@
+
+//
+// Saving and loading escape counts, to recolor an image without rendering it again
+//
+
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include "escape_counts.h"
+
+
+using namespace std;
+
+
+static const char magic[8] = { 'J', 'U', 'L', 'I', 'A', 'C', 'N', 'T' };
+static const unsigned int formatVersion = 1;
+// Larger max_iterations are taken for a damaged file: no image needs them, and they would overflow max_iterations + 1
+static const unsigned int maxFileIterations = 1u << 30;
+
+// Header of the file, after the magic
+struct CountsHeader {
+	unsigned int version, size, max_iterations;
+	// 2 or 4
+	unsigned int countBytes;
+	// 1 when the fractional parts follow the counts
+	unsigned int hasSmooth;
+};
+
+
+bool saveEscapeCounts(const EscapeCounts& counts, const char* fileName) {
+
+	const size_t pixels = (size_t)counts.size * counts.size;
+	if (counts.counts.size() != pixels || (!counts.smooth.empty() && counts.smooth.size() != pixels)) {
+		cout << "Escape counts do not match their size\n";
+		return false;
+	}
+	ofstream file(fileName, ios::out | ios::binary);
+	if (!file.is_open()) {
+		cout << "Cannot create file " << fileName << endl;
+		return false;
+	}
+
+	CountsHeader header = { formatVersion, counts.size, counts.max_iterations, counts.max_iterations <= 0xFFFF ? 2u : 4u, counts.smooth.empty() ? 0u : 1u };
+	file.write(magic, sizeof(magic));
+	file.write((const char*)&header, sizeof(header));
+
+	// 16 bit values are converted one row at a time, so no second copy of the image is needed
+	if (header.countBytes == 4) {
+		file.write((const char*)&counts.counts[0], pixels * sizeof(unsigned int));
+	}
+	else {
+		vector<unsigned short> row(counts.size);
+		for (size_t start = 0; start < pixels; start += counts.size) {
+			for (unsigned int x = 0; x < counts.size; x++) row[x] = (unsigned short)counts.counts[start + x];
+			file.write((const char*)&row[0], row.size() * sizeof(unsigned short));
+		}
+	}
+	if (header.hasSmooth) {
+		vector<unsigned short> row(counts.size);
+		for (size_t start = 0; start < pixels; start += counts.size) {
+			for (unsigned int x = 0; x < counts.size; x++) row[x] = (unsigned short)(counts.smooth[start + x] * 65535.0f + 0.5f);
+			file.write((const char*)&row[0], row.size() * sizeof(unsigned short));
+		}
+	}
+	return file.good();
+}
+
+
+bool loadEscapeCounts(const char* fileName, EscapeCounts& counts) {
+
+	ifstream file(fileName, ios::in | ios::binary);
+	if (!file.is_open()) {
+		cout << "Cannot open file " << fileName << endl;
+		return false;
+	}
+	char fileMagic[sizeof(magic)];
+	CountsHeader header;
+	file.read(fileMagic, sizeof(fileMagic));
+	file.read((char*)&header, sizeof(header));
+	if (!file || memcmp(fileMagic, magic, sizeof(magic)) != 0 || header.version != formatVersion || (header.countBytes != 2 && header.countBytes != 4) || header.size == 0
+		|| header.max_iterations > maxFileIterations || (header.countBytes == 2 && header.max_iterations > 0xFFFF)) {
+		cout << fileName << " is not an escape counts file\n";
+		return false;
+	}
+
+	const size_t pixels = (size_t)header.size * header.size;
+	counts.size = header.size;
+	counts.max_iterations = header.max_iterations;
+	counts.counts.resize(pixels);
+	counts.smooth.clear();
+	if (header.countBytes == 4) {
+		file.read((char*)&counts.counts[0], pixels * sizeof(unsigned int));
+	}
+	else {
+		vector<unsigned short> row(header.size);
+		for (size_t start = 0; start < pixels && file; start += header.size) {
+			file.read((char*)&row[0], row.size() * sizeof(unsigned short));
+			for (unsigned int x = 0; x < header.size; x++) counts.counts[start + x] = row[x];
+		}
+	}
+	if (header.hasSmooth) {
+		counts.smooth.resize(pixels);
+		vector<unsigned short> row(header.size);
+		for (size_t start = 0; start < pixels && file; start += header.size) {
+			file.read((char*)&row[0], row.size() * sizeof(unsigned short));
+			for (unsigned int x = 0; x < header.size; x++) counts.smooth[start + x] = row[x] / 65535.0f;
+		}
+	}
+	if (!file) {
+		cout << fileName << " is truncated\n";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+
+// Escape count of every pixel of a size x size image, in the row order of the image buffers (bottom row first),
+// so the image can be colored again with another palette without iterating again
+struct EscapeCounts {
+	unsigned int size, max_iterations;
+	// max_iterations for pixels of the set
+	std::vector<unsigned int> counts;
+	// Fractional part of the continuous escape count, between 0 and 1, for smooth coloring. Empty when not rendered
+	std::vector<float> smooth;
+};
+
+// Saves counts as a binary file: a header, the counts as 16 bit numbers when max_iterations fits, 32 bit otherwise,
+// and the fractional parts as 16 bit fixed point numbers. Little endian. Returns false when the file could not be written
+bool saveEscapeCounts(const EscapeCounts& counts, const char* fileName);
+
+// Reads a file written by saveEscapeCounts. Returns false when the file could not be read or is not a counts file, which includes
+// a max_iterations above 2^30 or one that does not fit its 16 bit counts
+bool loadEscapeCounts(const char* fileName, EscapeCounts& counts);
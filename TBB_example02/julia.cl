@@ -1,3 +1,61 @@
+// Specialised builds define some of the kernel parameters as compile time constants (-D), the kernel arguments are then ignored:
+// MAX_ITERATIONS, COLOR_COUNT, PALETTE (the B,G,R bytes of the COLOR_COUNT colors, comma separated) and NO_PERIODICITY (no cycle check)
+#ifdef MAX_ITERATIONS
+#define KERNEL_MAX_ITERATIONS MAX_ITERATIONS
+#else
+#define KERNEL_MAX_ITERATIONS max_iterations
+#endif
+
+#ifdef COLOR_COUNT
+#define KERNEL_COLOR_COUNT COLOR_COUNT
+#else
+#define KERNEL_COLOR_COUNT colorCount
+#endif
+
+#ifdef PALETTE
+constant uchar palette[] = { PALETTE };
+#define KERNEL_COLORS palette
+#else
+#define KERNEL_COLORS colors
+#endif
+
+#ifdef NO_PERIODICITY
+#define KERNEL_TOLERANCE 0.0f
+#else
+#define KERNEL_TOLERANCE periodicityTolerance
+#endif
+
+
+// Number of iterations before Z escapes, max_iterations when it does not escape. escaped, when not 0, receives the last Z
+uint escape_time(float2 Z, const float2 C, const uint max_iterations, const float periodicityTolerance, float2* escaped)
+{
+	// Brent's cycle detection: Z is saved after 1, 2, 4, 8, ... iterations, a later Z within the tolerance means the orbit is cyclic (interior)
+	float2 saved = Z;
+	uint checkLength = 1;
+	uint period = 0;
+
+	uint i;
+	for (i = 0; i < max_iterations; i++) {
+		Z = (float2)(Z.x*Z.x - Z.y*Z.y + C.x , Z.x*Z.y*2.0f + C.y);
+
+		if (Z.x*Z.x + Z.y*Z.y > 4.0f){
+			break;
+		}
+		if (periodicityTolerance > 0.0f) {
+			float2 difference = fabs(Z - saved);
+			if (difference.x < periodicityTolerance && difference.y < periodicityTolerance) {
+				return max_iterations;
+			}
+			if (++period == checkLength) {
+				period = 0;
+				checkLength *= 2;
+				saved = Z;
+			}
+		}
+	}
+	if (escaped) *escaped = Z;
+	return i;
+}
 
 kernel void julia_kernel(
 	global uchar* outputBuffer, // array of BGR pixels, length of size*3 bytes (byte == uchar)
@@ -5,7 +63,8 @@ kernel void julia_kernel(
 	const uint max_iterations,
 	const float limit,
 	global uchar* colors,
-	const uint colorCount
+	const uint colorCount,
+	const float periodicityTolerance // 0 disables the cycle check
 	)
 {
 
@@ -18,22 +77,285 @@ kernel void julia_kernel(
 	
 	float2 Z = (float2)(-limit + 2.0f * limit * x / size , -limit + 2.0f * limit * y / size);
 
-	uint i;
-	for (i = 0; i < max_iterations; i++) {
-		Z = (float2)(Z.x*Z.x - Z.y*Z.y + C.x , Z.x*Z.y*2.0f + C.y);
+	uint i = escape_time(Z, C, KERNEL_MAX_ITERATIONS, KERNEL_TOLERANCE, 0);
 
-		if (Z.x*Z.x + Z.y*Z.y > 4.0f){
-			break;
+	// Black is written too: outputBuffer is reused between frames, so it still holds the previous image
+	uint o = (y * size + x)*3;
+	if (i < KERNEL_MAX_ITERATIONS) { 
+		uint ic =  i % KERNEL_COLOR_COUNT * 3;
+		outputBuffer[o] = KERNEL_COLORS[ic]; //B
+		outputBuffer[o+1] = KERNEL_COLORS[ic+1]; //G
+		outputBuffer[o+2] = KERNEL_COLORS[ic+2]; //R
+	}
+	else {
+		outputBuffer[o] = 0;
+		outputBuffer[o+1] = 0;
+		outputBuffer[o+2] = 0;
+	}
+}
+
+// julia_kernel with a tunable launch, see OpenCLJulia::autotune: every work item renders pixelsPerItem (at most TUNED_MAX_PIXELS)
+// neighbouring pixels of a row, and with vectorStores collects them and writes them with vector stores instead of one byte at a time.
+// The NDRange may be padded to a multiple of the work group size, work items beyond the image do nothing
+#define TUNED_MAX_PIXELS 8
+kernel void julia_tuned_kernel(
+	global uchar* outputBuffer,
+	const float2 C,
+	const uint max_iterations,
+	const float limit,
+	global uchar* colors,
+	const uint colorCount,
+	const float periodicityTolerance,
+	const uint size,
+	const uint pixelsPerItem,
+	const uint vectorStores
+	)
+{
+	uint x = get_global_id(0) * pixelsPerItem;
+	uint y = get_global_id(1);
+	if (x >= size || y >= size) return;
+	uint count = min(pixelsPerItem, size - x);
+
+	global uchar* out = outputBuffer + (y * size + x) * 3;
+	uchar pixels[3 * TUNED_MAX_PIXELS];
+	for (uint p = 0; p < count; p++) {
+		float2 Z = (float2)(-limit + 2.0f * limit * (x + p) / size , -limit + 2.0f * limit * y / size);
+
+		uint i = escape_time(Z, C, KERNEL_MAX_ITERATIONS, KERNEL_TOLERANCE, 0);
+
+		uchar3 color = (uchar3)(0, 0, 0);
+		if (i < KERNEL_MAX_ITERATIONS) {
+			uint ic = i % KERNEL_COLOR_COUNT * 3;
+			color = (uchar3)(KERNEL_COLORS[ic], KERNEL_COLORS[ic+1], KERNEL_COLORS[ic+2]);
+		}
+		if (vectorStores) {
+			pixels[3*p] = color.x;
+			pixels[3*p+1] = color.y;
+			pixels[3*p+2] = color.z;
+		}
+		else {
+			out[3*p] = color.x;
+			out[3*p+1] = color.y;
+			out[3*p+2] = color.z;
 		}
 	}
+	if (vectorStores) {
+		uint b = 0;
+		for (; b + 8 <= 3 * count; b += 8) vstore8(vload8(0, pixels + b), 0, out + b);
+		for (; b + 4 <= 3 * count; b += 4) vstore4(vload4(0, pixels + b), 0, out + b);
+		for (; b < 3 * count; b++) out[b] = pixels[b];
+	}
+}
+
+// Renders a region of a size x size image. The NDRange covers the region: its global offset is the corner of the region,
+// outputBuffer holds only the region. Every pixel is written, black included
+kernel void julia_region_kernel(
+	global uchar* outputBuffer, // array of BGR pixels, length of region width * height * 3 bytes
+	const float2 C,
+	const uint max_iterations,
+	const float limit,
+	global uchar* colors,
+	const uint colorCount,
+	const float periodicityTolerance,
+	const uint size
+	)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+
+	float2 Z = (float2)(-limit + 2.0f * limit * x / size , -limit + 2.0f * limit * y / size);
+
+	uint i = escape_time(Z, C, KERNEL_MAX_ITERATIONS, KERNEL_TOLERANCE, 0);
+
+	uint o = ((y - get_global_offset(1)) * get_global_size(0) + (x - get_global_offset(0))) * 3;
+	if (i < KERNEL_MAX_ITERATIONS) {
+		uint ic = i % KERNEL_COLOR_COUNT * 3;
+		outputBuffer[o] = KERNEL_COLORS[ic];
+		outputBuffer[o+1] = KERNEL_COLORS[ic+1];
+		outputBuffer[o+2] = KERNEL_COLORS[ic+2];
+	}
+	else {
+		outputBuffer[o] = 0;
+		outputBuffer[o+1] = 0;
+		outputBuffer[o+2] = 0;
+	}
+}
+
+// Escape counts instead of colors, for coloring on the host (see colorCounts): max_iterations for the set.
+// smooth, when not 0, receives the fractional part of the continuous count, as in JuliaGenerator::smoothFraction
+kernel void julia_count_kernel(
+	global uint* counts, // size*size counts
+	global float* smooth,
+	const float2 C,
+	const uint max_iterations,
+	const float limit,
+	const float periodicityTolerance
+	)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	int size = get_global_size(0);
+
+	float2 Z = (float2)(-limit + 2.0f * limit * x / size , -limit + 2.0f * limit * y / size);
+
+	float2 escaped;
+	uint i = escape_time(Z, C, KERNEL_MAX_ITERATIONS, KERNEL_TOLERANCE, &escaped);
+
+	uint o = y * size + x;
+	counts[o] = i;
+	if (smooth) {
+		smooth[o] = i < KERNEL_MAX_ITERATIONS ? clamp(2.0f - log2(log2(dot(escaped, escaped))), 0.0f, 1.0f) : 0.0f;
+	}
+}
+
+// Escape counts of arbitrary points of a size x size image, e.g. the subsamples of anti-aliasing. points are in pixel coordinates,
+// pixel (x, y) lies at (x, y). One work item per point
+kernel void julia_sample_kernel(
+	global const float2* points,
+	global uint* counts,
+	const float2 C,
+	const uint max_iterations,
+	const float limit,
+	const float periodicityTolerance,
+	const uint size
+	)
+{
+	int s = get_global_id(0);
+	float2 p = points[s];
+
+	float2 Z = (float2)(-limit + 2.0f * limit * p.x / size , -limit + 2.0f * limit * p.y / size);
+
+	counts[s] = escape_time(Z, C, KERNEL_MAX_ITERATIONS, KERNEL_TOLERANCE, 0);
+}
+
+// Thumbnails of the Julia sets of many C values in one atlas, in one NDRange of size x size x (columns * rows): dimension 2 is the cell of the atlas.
+// Cell c lies in column c % columns and row rows - 1 - c / columns of the buffer, which is columns * size pixels wide. Cells from count on are black.
+// interior, when not 0, counts the pixels of every C that did not escape (zeroed by the host)
+kernel void julia_atlas_kernel(
+	global uchar* atlas,
+	global const float2* Cs,
+	global uint* interior,
+	const uint count,
+	const uint max_iterations,
+	const float limit,
+	global uchar* colors,
+	const uint colorCount,
+	const float periodicityTolerance,
+	const uint columns,
+	const uint rows
+	)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	uint c = get_global_id(2);
+	int size = get_global_size(0);
+
+	uint atlasY = (rows - 1 - c / columns) * size + y;
+	uint o = (atlasY * columns * size + c % columns * size + x) * 3;
+	if (c >= count) {
+		atlas[o] = 0;
+		atlas[o+1] = 0;
+		atlas[o+2] = 0;
+		return;
+	}
+
+	float2 Z = (float2)(-limit + 2.0f * limit * x / size , -limit + 2.0f * limit * y / size);
+
+	uint i = escape_time(Z, Cs[c], KERNEL_MAX_ITERATIONS, KERNEL_TOLERANCE, 0);
+
+	if (i < KERNEL_MAX_ITERATIONS) {
+		uint ic = i % KERNEL_COLOR_COUNT * 3;
+		atlas[o] = KERNEL_COLORS[ic];
+		atlas[o+1] = KERNEL_COLORS[ic+1];
+		atlas[o+2] = KERNEL_COLORS[ic+2];
+	}
+	else {
+		atlas[o] = 0;
+		atlas[o+1] = 0;
+		atlas[o+2] = 0;
+		if (interior) atomic_inc(&interior[c]);
+	}
+}
+
+// Resumable rendering: the escape counts stay on the device, together with the pixels that did not escape (survivors) and their Z,
+// so a higher max_iterations only continues the survivors. These kernels never use the periodicity check, a cyclic pixel may still escape later
+
+// Continues Z from iteration i. Returns the iteration on which Z escaped, max_iterations when it did not escape
+uint continue_orbit(float2* Z, const float2 C, uint i, const uint max_iterations)
+{
+	float2 z = *Z;
+	for (; i < max_iterations; i++) {
+		z = (float2)(z.x*z.x - z.y*z.y + C.x , z.x*z.y*2.0f + C.y);
+		if (z.x*z.x + z.y*z.y > 4.0f) break;
+	}
+	*Z = z;
+	return i;
+}
+
+// First pass: the counts of all pixels, with the Z of every pixel in denseZ. survivorCount (0 before the pass) counts the survivors
+kernel void julia_start_kernel(
+	global uint* counts, // size*size counts
+	global float2* denseZ, // size*size
+	global uint* survivorCount,
+	const float2 C,
+	const uint max_iterations,
+	const float limit
+	)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	int size = get_global_size(0);
+
+	float2 Z = (float2)(-limit + 2.0f * limit * x / size , -limit + 2.0f * limit * y / size);
+	uint i = continue_orbit(&Z, C, 0, max_iterations);
+
+	uint o = y * size + x;
+	counts[o] = i;
+	denseZ[o] = Z;
+	if (i == max_iterations) atomic_inc(survivorCount);
+}
+
+// Appends the survivors of the first pass to pixels and Zs, in no particular order. survivorCount has to be 0 before the pass
+kernel void julia_compact_kernel(
+	global const uint* counts,
+	global const float2* denseZ,
+	global uint* pixels,
+	global float2* Zs,
+	global uint* survivorCount,
+	const uint max_iterations
+	)
+{
+	uint o = get_global_id(1) * get_global_size(0) + get_global_id(0);
+	if (counts[o] == max_iterations) {
+		uint s = atomic_inc(survivorCount);
+		pixels[s] = o;
+		Zs[s] = denseZ[o];
+	}
+}
+
+// Next pass, over the survivors: continues them from iterations up to max_iterations and appends the ones that still
+// do not escape to nextPixels and nextZs. nextCount has to be 0 before the pass
+kernel void julia_resume_kernel(
+	global uint* counts,
+	global const uint* pixels,
+	global const float2* Zs,
+	global uint* nextPixels,
+	global float2* nextZs,
+	global uint* nextCount,
+	const float2 C,
+	const uint iterations,
+	const uint max_iterations
+	)
+{
+	uint s = get_global_id(0);
+	uint o = pixels[s];
+	float2 Z = Zs[s];
+	uint i = continue_orbit(&Z, C, iterations, max_iterations);
 
-	// this if-statement can be avoided by using a color array that contains black too. 
-	if (i < max_iterations) { 
-		uint ic =  i % colorCount * 3;
-		i =(y * size + x)*3;
-		outputBuffer[i] = colors[ic]; //B
-		outputBuffer[i+1] = colors[ic+1]; //G
-		outputBuffer[i+2] = colors[ic+2]; //R
+	counts[o] = i;
+	if (i == max_iterations) {
+		uint n = atomic_inc(nextCount);
+		nextPixels[n] = o;
+		nextZs[n] = Z;
 	}
-	//default color == black; else unnecesarry
 }
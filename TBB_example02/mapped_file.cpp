@@ -0,0 +1,135 @@
+
+//
+// Windowed memory mapping of output files larger than memory
+//
+
+
+#include <iostream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "mapped_file.h"
+
+
+using namespace std;
+
+
+// Offsets of a view have to be a multiple of this
+static unsigned long long mappingGranularity() {
+
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwAllocationGranularity;
+#else
+	return (unsigned long long)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+
+MappedFile::MappedFile(const char* fileName, unsigned long long fileSize) : fileSize(fileSize), view(nullptr), viewLength(0) {
+
+#ifdef _WIN32
+	mapping = nullptr;
+	file = CreateFileA(fileName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		cout << "Cannot create file " << fileName << endl;
+		file = nullptr;
+		return;
+	}
+
+	// Creating the mapping with the final size extends the file
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE, (DWORD)(fileSize >> 32), (DWORD)(fileSize & 0xFFFFFFFF), nullptr);
+	if (!mapping) {
+		cout << "Cannot map file " << fileName << " of " << fileSize << " bytes\n";
+		CloseHandle(file);
+		file = nullptr;
+	}
+#else
+	file = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file < 0) {
+		cout << "Cannot create file " << fileName << endl;
+		return;
+	}
+
+	if (ftruncate(file, (off_t)fileSize) != 0) {
+		cout << "Cannot resize file " << fileName << " to " << fileSize << " bytes\n";
+		close(file);
+		file = -1;
+	}
+#endif
+}
+
+
+MappedFile::~MappedFile() {
+
+	unmap();
+#ifdef _WIN32
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+#else
+	if (file >= 0) close(file);
+#endif
+}
+
+
+bool MappedFile::isValid() const {
+
+#ifdef _WIN32
+	return file != nullptr;
+#else
+	return file >= 0;
+#endif
+}
+
+
+unsigned long long MappedFile::getFileSize() const {
+
+	return fileSize;
+}
+
+
+unsigned char* MappedFile::map(unsigned long long offset, size_t length) {
+
+	unmap();
+	if (!isValid() || offset + length > fileSize) {
+		cout << "Cannot map " << length << " bytes at offset " << offset << endl;
+		return nullptr;
+	}
+
+	// Start the view at the preceding multiple of the granularity
+	unsigned long long start = offset - offset % mappingGranularity();
+	size_t delta = (size_t)(offset - start);
+
+#ifdef _WIN32
+	view = MapViewOfFile(mapping, FILE_MAP_WRITE, (DWORD)(start >> 32), (DWORD)(start & 0xFFFFFFFF), length + delta);
+#else
+	view = mmap(nullptr, length + delta, PROT_READ | PROT_WRITE, MAP_SHARED, file, (off_t)start);
+	if (view == MAP_FAILED) view = nullptr;
+#endif
+
+	if (!view) {
+		cout << "Cannot map " << length << " bytes at offset " << offset << endl;
+		return nullptr;
+	}
+	viewLength = length + delta;
+	return (unsigned char*)view + delta;
+}
+
+
+void MappedFile::unmap() {
+
+	if (!view) return;
+#ifdef _WIN32
+	FlushViewOfFile(view, viewLength);
+	UnmapViewOfFile(view);
+#else
+	munmap(view, viewLength);
+#endif
+	view = nullptr;
+	viewLength = 0;
+}
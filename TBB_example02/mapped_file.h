@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+// Output file that is written through a memory mapped window, so only the window has to fit in memory (and in the address space of a 32 bit process).
+// The file is created (or truncated) with its final size; bytes that are never written read as 0.
+class MappedFile {
+public:
+	MappedFile(const char* fileName, unsigned long long fileSize);
+	~MappedFile();
+
+	// false when the file could not be created
+	bool isValid() const;
+
+	unsigned long long getFileSize() const;
+
+	// Maps the bytes [offset, offset + length) and returns a pointer to the byte at offset. The previous window is flushed and unmapped first.
+	// Returns nullptr on error
+	unsigned char* map(unsigned long long offset, size_t length);
+
+	// Flushes and unmaps the current window, if any
+	void unmap();
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	int file;
+#endif
+	unsigned long long fileSize;
+	// Start and length of the current view, aligned to the allocation granularity of the system
+	void* view;
+	size_t viewLength;
+};
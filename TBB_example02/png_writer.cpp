@@ -0,0 +1,277 @@
+
+//
+// Streaming PNG encoder on top of zlib
+//
+
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <tbb/tbb.h>
+#include "png_writer.h"
+
+
+using namespace std;
+using namespace tbb;
+
+
+// Size of the zlib output buffer, and so the maximum size of an IDAT chunk
+static const size_t compressedBufferSize = 256 * 1024;
+
+
+// Appends a 32 bit big endian value, the byte order of every PNG number
+static void putBigEndian(unsigned char* target, unsigned long value) {
+
+	target[0] = (unsigned char)(value >> 24);
+	target[1] = (unsigned char)(value >> 16);
+	target[2] = (unsigned char)(value >> 8);
+	target[3] = (unsigned char)value;
+}
+
+
+static void writeChunk(ofstream& file, const char* type, const unsigned char* data, size_t length) {
+
+	unsigned char number[4];
+	putBigEndian(number, (unsigned long)length);
+	file.write((const char*)number, 4);
+	file.write(type, 4);
+	if (length) file.write((const char*)data, length);
+
+	// The CRC covers the type and the data
+	uLong crc = crc32(0L, (const Bytef*)type, 4);
+	if (length) crc = crc32(crc, data, (uInt)length);
+	putBigEndian(number, crc);
+	file.write((const char*)number, 4);
+}
+
+
+// Signature and IHDR: width, height, 8 bits per channel, color type 2 (RGB), deflate, adaptive filtering, no interlacing
+static void writeHeader(ofstream& file, unsigned int width, unsigned int height) {
+
+	static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	file.write((const char*)signature, sizeof(signature));
+
+	unsigned char header[13];
+	putBigEndian(header, width);
+	putBigEndian(header + 4, height);
+	header[8] = 8;
+	header[9] = 2;
+	header[10] = 0;
+	header[11] = 0;
+	header[12] = 0;
+	writeChunk(file, "IHDR", header, sizeof(header));
+}
+
+
+// Filter type 1 (Sub): every byte minus the same channel of the pixel to its left, cheap and good for long runs of one color.
+// Writes the filter type byte and the filtered RGB row to out
+static void filterRow(const unsigned char* bgrRow, unsigned int width, unsigned char* out) {
+
+	*out++ = 1;
+	unsigned char left[3] = { 0, 0, 0 };
+	for (unsigned int x = 0; x < width; x++) {
+		const unsigned char* bgr = bgrRow + 3 * x;
+		const unsigned char rgb[3] = { bgr[2], bgr[1], bgr[0] };
+		for (int c = 0; c < 3; c++) {
+			*out++ = (unsigned char)(rgb[c] - left[c]);
+			left[c] = rgb[c];
+		}
+	}
+}
+
+
+PngWriter::PngWriter(const char* fileName, unsigned int width, unsigned int height, int compressionLevel)
+	: file(fileName, ios::out | ios::binary), width(width), height(height), rowsWritten(0), streamOpen(false), valid(false),
+	filteredRow(1 + (size_t)width * 3), compressed(compressedBufferSize) {
+
+	if (!file.is_open()) {
+		cout << "Cannot create file " << fileName << endl;
+		return;
+	}
+
+	memset(&stream, 0, sizeof(stream));
+	if (deflateInit(&stream, compressionLevel) != Z_OK) {
+		cout << "Cannot initialise zlib\n";
+		return;
+	}
+	streamOpen = true;
+	valid = true;
+
+	writeHeader(file, width, height);
+
+	stream.next_out = &compressed[0];
+	stream.avail_out = (uInt)compressed.size();
+}
+
+
+PngWriter::~PngWriter() {
+
+	close();
+	if (streamOpen) deflateEnd(&stream);
+}
+
+
+bool PngWriter::isValid() const {
+
+	return valid && file.good();
+}
+
+
+bool PngWriter::writeRow(const unsigned char* bgrRow) {
+
+	if (!isValid() || rowsWritten == height) return false;
+
+	filterRow(bgrRow, width, &filteredRow[0]);
+	stream.next_in = &filteredRow[0];
+	stream.avail_in = (uInt)filteredRow.size();
+	rowsWritten++;
+	return deflateRows(Z_NO_FLUSH);
+}
+
+
+bool PngWriter::close() {
+
+	if (!streamOpen || !valid) return false;
+	if (rowsWritten != height) {
+		cout << "PNG closed after " << rowsWritten << " of " << height << " rows\n";
+	}
+
+	stream.next_in = nullptr;
+	stream.avail_in = 0;
+	bool ok = deflateRows(Z_FINISH);
+	writeChunk(file, "IEND", nullptr, 0);
+	file.close();
+	valid = false;
+	return ok;
+}
+
+
+bool PngWriter::deflateRows(int flush) {
+
+	for (;;) {
+		int result = deflate(&stream, flush);
+		if (result == Z_STREAM_ERROR) {
+			cout << "zlib error while compressing\n";
+			valid = false;
+			return false;
+		}
+
+		bool full = stream.avail_out == 0;
+		bool finished = result == Z_STREAM_END;
+		if (full || (finished && stream.avail_out < compressed.size())) {
+			writeChunk(file, "IDAT", &compressed[0], compressed.size() - stream.avail_out);
+			stream.next_out = &compressed[0];
+			stream.avail_out = (uInt)compressed.size();
+		}
+
+		if (finished) return file.good();
+		// Without Z_FINISH zlib is done as soon as all input is consumed and there was room left in the output
+		if (flush != Z_FINISH && stream.avail_in == 0 && !full) return file.good();
+	}
+}
+
+
+// One strip of writePngParallel: its filtered rows compressed as raw deflate data, and the Adler-32 checksum of the filtered rows
+struct PngStrip {
+	vector<unsigned char> compressed;
+	uLong adler;
+	size_t filteredBytes;
+	bool ok;
+};
+
+
+// Compresses the rows [first, end) of the image into strip, one row at a time. The last strip ends the deflate stream, the others end on a byte boundary
+static void compressStrip(const unsigned char* bgrPixels, unsigned int width, unsigned int height, size_t pitch, bool bottomUp, int compressionLevel,
+	unsigned int first, unsigned int end, PngStrip& strip) {
+
+	vector<unsigned char> filteredRow(1 + (size_t)width * 3);
+	strip.filteredBytes = filteredRow.size() * (end - first);
+	strip.adler = adler32(0L, nullptr, 0);
+	strip.ok = false;
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	// Negative window bits: raw deflate data, the zlib header and checksum are written once for the whole image
+	if (deflateInit2(&stream, compressionLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+	// Julia images compress well, the buffer doubles whenever it is full
+	strip.compressed.resize(strip.filteredBytes / 8 + 1024);
+	size_t produced = 0;
+	for (unsigned int y = first; y <= end; y++) {
+		int flush = Z_NO_FLUSH;
+		if (y < end) {
+			const unsigned int row = bottomUp ? height - 1 - y : y;
+			filterRow(bgrPixels + row * pitch, width, &filteredRow[0]);
+			strip.adler = adler32(strip.adler, &filteredRow[0], (uInt)filteredRow.size());
+			stream.next_in = &filteredRow[0];
+			stream.avail_in = (uInt)filteredRow.size();
+		}
+		else {
+			flush = end == height ? Z_FINISH : Z_SYNC_FLUSH;
+		}
+		for (;;) {
+			if (produced == strip.compressed.size()) strip.compressed.resize(2 * strip.compressed.size());
+			stream.next_out = &strip.compressed[produced];
+			stream.avail_out = (uInt)(strip.compressed.size() - produced);
+			int result = deflate(&stream, flush);
+			produced = strip.compressed.size() - stream.avail_out;
+			if (result == Z_STREAM_ERROR) {
+				deflateEnd(&stream);
+				return;
+			}
+			// Done when all input is consumed with room to spare, which Z_SYNC_FLUSH needs too; Z_FINISH until the end of the stream
+			if (flush == Z_FINISH ? result == Z_STREAM_END : (stream.avail_in == 0 && stream.avail_out > 0)) break;
+		}
+	}
+	strip.compressed.resize(produced);
+	strip.ok = true;
+	deflateEnd(&stream);
+}
+
+
+bool writePngParallel(const char* fileName, const unsigned char* bgrPixels, unsigned int width, unsigned int height, size_t pitch, bool bottomUp,
+	int compressionLevel, unsigned int stripRows) {
+
+	ofstream file(fileName, ios::out | ios::binary);
+	if (!file.is_open()) {
+		cout << "Cannot create file " << fileName << endl;
+		return false;
+	}
+	if (stripRows == 0) {
+		// A few strips per thread for the load balance, but not so small that the strips stop compressing well
+		stripRows = max(16u, height / (4u * (unsigned int)this_task_arena::max_concurrency()) + 1u);
+	}
+	const unsigned int strips = (height + stripRows - 1) / stripRows;
+	vector<PngStrip> compressed(strips);
+	parallel_for(
+		blocked_range<unsigned int>(0, strips, 1),
+		[&](const blocked_range<unsigned int>& r) {
+
+			for (unsigned int s = r.begin(); s < r.end(); s++) {
+				compressStrip(bgrPixels, width, height, pitch, bottomUp, compressionLevel, s * stripRows, min(height, (s + 1) * stripRows), compressed[s]);
+			}
+	});
+
+	// zlib header: deflate with a 32K window, and the compression level as a hint (FLEVEL), with the check bits making it a multiple of 31
+	const int level = compressionLevel == Z_DEFAULT_COMPRESSION ? 6 : compressionLevel;
+	const unsigned char zlibHeader[2] = { 0x78, (unsigned char)(level < 2 ? 0x01 : level < 6 ? 0x5E : level == 6 ? 0x9C : 0xDA) };
+	uLong adler = adler32(0L, nullptr, 0);
+	for (const PngStrip& strip : compressed) {
+		if (!strip.ok) {
+			cout << "zlib error while compressing\n";
+			return false;
+		}
+		adler = adler32_combine(adler, strip.adler, (z_off_t)strip.filteredBytes);
+	}
+	unsigned char zlibTrailer[4];
+	putBigEndian(zlibTrailer, adler);
+
+	// Every strip is an IDAT chunk of its own, the header in the first and the checksum in the last chunk
+	writeHeader(file, width, height);
+	writeChunk(file, "IDAT", zlibHeader, sizeof(zlibHeader));
+	for (const PngStrip& strip : compressed) {
+		if (!strip.compressed.empty()) writeChunk(file, "IDAT", &strip.compressed[0], strip.compressed.size());
+	}
+	writeChunk(file, "IDAT", zlibTrailer, sizeof(zlibTrailer));
+	writeChunk(file, "IEND", nullptr, 0);
+	return file.good();
+}
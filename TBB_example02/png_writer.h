@@ -0,0 +1,47 @@
+#pragma once
+
+#include <fstream>
+#include <vector>
+#include <cstddef>
+#include <zlib.h>
+
+// Streaming writer for 24 bit PNG files: every row is filtered and compressed as soon as it arrives,
+// so encoding can start before the image is complete and the image never has to be in memory as a whole.
+class PngWriter {
+public:
+	// compressionLevel is the zlib level: 0 (store) to 9 (best), Z_DEFAULT_COMPRESSION is 6
+	PngWriter(const char* fileName, unsigned int width, unsigned int height, int compressionLevel = Z_DEFAULT_COMPRESSION);
+	~PngWriter();
+
+	// false when the file could not be created or an earlier write failed
+	bool isValid() const;
+
+	// Appends the next row, in top-down order. bgrRow holds width pixels in FreeImage (BGR) order
+	bool writeRow(const unsigned char* bgrRow);
+
+	// Finishes the compressed stream and writes the end of the file. Called by the destructor if needed
+	bool close();
+
+private:
+	PngWriter(const PngWriter&);
+	PngWriter& operator=(const PngWriter&);
+
+	// Compresses the pending input of the stream with the given flush mode, writing an IDAT chunk whenever the output buffer is full
+	bool deflateRows(int flush);
+
+	std::ofstream file;
+	unsigned int width, height, rowsWritten;
+	z_stream stream;
+	bool streamOpen, valid;
+	// Filter type byte followed by the filtered RGB row
+	std::vector<unsigned char> filteredRow;
+	std::vector<unsigned char> compressed;
+};
+
+// Writes a whole 24 bit image as PNG, compressing strips of stripRows rows in parallel (TBB). Every strip is an independent deflate stream,
+// flushed to a byte boundary, so the strips simply follow each other in one valid zlib stream whose checksum is combined from theirs.
+// Slightly larger than a single stream, since no strip can refer back to the one before it. stripRows 0 picks strips for the number of threads.
+// bgrPixels holds height rows of width pixels in FreeImage (BGR) order, pitch bytes apart, bottom row first when bottomUp (like FreeImage buffers).
+// Returns false when the file could not be written
+bool writePngParallel(const char* fileName, const unsigned char* bgrPixels, unsigned int width, unsigned int height, size_t pitch, bool bottomUp,
+	int compressionLevel = Z_DEFAULT_COMPRESSION, unsigned int stripRows = 0);
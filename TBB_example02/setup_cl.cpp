@@ -9,7 +9,11 @@
 #include <sstream>
 #include <string>
 #include <locale>
-#include <exception>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <vector>
 #include "setup_cl.h"
 
 
@@ -33,20 +37,20 @@ cl_context createContext(const char* platform) {
 		clerr = clGetPlatformIDs(0, nullptr, &numPlatforms);
 
 		if (clerr != CL_SUCCESS || numPlatforms == 0)
-			throw exception("No OpenCL platforms found");
+			throw runtime_error("No OpenCL platforms found");
 
 		// Create the array of available platforms
 		platformArray = (cl_platform_id*)malloc(numPlatforms * sizeof(cl_platform_id));
 
 		if (!platformArray)
-			throw exception("Unable to create platform array");
+			throw runtime_error("Unable to create platform array");
 
 		// Get platform list - for this application we'll use only the first platform found
 		clerr = clGetPlatformIDs(numPlatforms, platformArray, nullptr);
 
 		// Validate returned platform
 		if (clerr != CL_SUCCESS || numPlatforms == 0)
-			throw exception("Unable to obtain platform information");
+			throw runtime_error("Unable to obtain platform information");
 
 		// Cycle through each platform and display information
 		for (cl_uint i = 0; i < numPlatforms; ++i) {
@@ -119,6 +123,9 @@ cl_context createContext(const char* platform) {
 
 		cout << "\nSelected platform index = " << platformIndex << "\n\n\n";
 
+		if (platformIndex == -1)
+			throw runtime_error("Requested OpenCL platform not found");
+
 		// Create OpenCL context based on the first available nVidia platform
 		cl_context_properties contextProperties[] = {
 
@@ -129,8 +136,14 @@ cl_context createContext(const char* platform) {
 
 		context = clCreateContextFromType(contextProperties, CL_DEVICE_TYPE_GPU, nullptr, nullptr, nullptr);
 
+		// CPU implementations (e.g. pocl) have no GPU device: use whatever device the platform has
+		if (!context) {
+			cout << "No GPU device on the selected platform, trying all device types\n";
+			context = clCreateContextFromType(contextProperties, CL_DEVICE_TYPE_ALL, nullptr, nullptr, nullptr);
+		}
+
 		if (clerr != CL_SUCCESS || !context)
-			throw exception("Unable to create a valid GPU context");
+			throw runtime_error("Unable to create a valid context");
 
 		return context;
 	}
@@ -218,24 +231,76 @@ cl_command_queue createCommandQueue(cl_context context, cl_device_id *device) {
 
 
 
-// Helper function to load the kernel source code from a suitable (text) file and setup an OpenCL program object
-cl_program createProgram(cl_context context, cl_device_id device, const char* fileName) {
+// Returns the string value of a platform or device query
+template <typename Handle, typename Info>
+static string queryString(cl_int(CL_API_CALL *query)(Handle, Info, size_t, void*, size_t*), Handle handle, Info what) {
+
+	size_t resultSize = 0;
+	if (query(handle, what, 0, nullptr, &resultSize) != CL_SUCCESS || resultSize == 0)
+		return string();
+
+	string result(resultSize, '\0');
+	query(handle, what, resultSize, &result[0], nullptr);
+	// Without the terminating zero
+	result.resize(strlen(result.c_str()));
+	return result;
+}
+
+
+static string toUpper(string text) {
+
+	locale loc;
+	for (size_t k = 0; k < text.size(); ++k)
+		text[k] = toupper(text[k], loc);
+	return text;
+}
+
+
+// Reads the kernel source code from a (text) file, the extension can be anything
+static bool readSource(const char* fileName, string& source) {
 
-	// Open the kernel file - the extension can be anything, including .txt since it's just a text file
 	ifstream kernelFile(fileName, ios::in);
 
 	if (!kernelFile.is_open()) {
 
 		cout << "Cannot open source file " << fileName << endl;
-		return nullptr;
+		return false;
 	}
 
-	// Store the file contents in a stringstream object
 	ostringstream oss;
 	oss << kernelFile.rdbuf();
+	source = oss.str();
+	return true;
+}
+
+
+// Builds program for device, prints the build log on failure and releases the program
+static cl_int buildProgram(cl_program program, cl_device_id device, const char* options) {
+
+	cl_int err = clBuildProgram(program, 1, &device, options, 0, 0);
+
+	if (err != CL_SUCCESS) {
 
-	// Extract a std::string from the stringstream object
-	string srcString = oss.str();
+		size_t logSize;
+		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
+
+		char *buildLog = (char *)calloc(logSize + 1, 1);
+
+		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, logSize, buildLog, nullptr);
+
+		cout << "Error in kernel:\n\n";
+		cout << buildLog;
+
+		// Clean-up
+		free(buildLog);
+		clReleaseProgram(program);
+	}
+
+	return err;
+}
+
+
+static cl_program createProgramFromSource(cl_context context, cl_device_id device, const string& srcString, const char* options) {
 
 	// Obtain the pointer to the contained C string
 	const char* src = srcString.c_str();
@@ -246,30 +311,322 @@ cl_program createProgram(cl_context context, cl_device_id device, const char* fi
 
 	if (!program) {
 
-		cout << "Cannot create program from source file " << fileName << endl;
+		cout << "Cannot create program from source\n";
 		return nullptr;
 	}
 
 	// Attempt to build program object
-	err = clBuildProgram(program, 0, 0, 0, 0, 0);
+	if (buildProgram(program, device, options) != CL_SUCCESS)
+		return nullptr;
 
-	if (err != CL_SUCCESS) {
+	return program;
+}
 
-		size_t logSize;
-		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &logSize);
 
-		char *buildLog = (char *)calloc(logSize + 1, 1);
+// Helper function to load the kernel source code from a suitable (text) file and setup an OpenCL program object.
+// options are passed to the compiler, e.g. -D definitions
+cl_program createProgram(cl_context context, cl_device_id device, const char* fileName, const char* options) {
 
-		clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, logSize, buildLog, nullptr);
+	string srcString;
 
-		cout << "Error in kernel:\n\n";
-		cout << buildLog;
+	if (!readSource(fileName, srcString))
+		return nullptr;
+
+	return createProgramFromSource(context, device, srcString, options);
+}
+
+
+// 64 bit FNV-1a hash, to name cache files
+static unsigned long long hashText(const string& text, unsigned long long hash = 14695981039346656037ull) {
+
+	for (size_t i = 0; i < text.size(); ++i) {
+
+		hash ^= (unsigned char)text[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
 
-		// Clean-up
-		clReleaseProgram(program);
 
+// Platform and device names, driver and OpenCL version, separated by '|'
+string deviceKey(cl_device_id device) {
+
+	cl_platform_id platform = nullptr;
+	clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, nullptr);
+	return queryString(clGetPlatformInfo, platform, (cl_platform_info)CL_PLATFORM_NAME) + "|" + queryString(clGetDeviceInfo, device, (cl_device_info)CL_DEVICE_NAME) + "|"
+		+ queryString(clGetDeviceInfo, device, (cl_device_info)CL_DRIVER_VERSION) + "|" + queryString(clGetDeviceInfo, device, (cl_device_info)CL_DEVICE_VERSION) + "|";
+}
+
+
+// Helper function like createProgram, that first looks for a binary built earlier for the same device, driver, options and source.
+// The binary is stored next to the source as <fileName>.<hash>.bin; a binary the driver rejects is rebuilt from source and replaced
+cl_program createProgramCached(cl_context context, cl_device_id device, const char* fileName, const char* options, bool* fromCache) {
+
+	if (fromCache)
+		*fromCache = false;
+
+	string srcString;
+
+	if (!readSource(fileName, srcString))
 		return nullptr;
+
+	// Everything that makes a binary unusable goes into the key
+	string key = deviceKey(device) + (options ? options : "") + "|";
+	ostringstream cacheName;
+	cacheName << fileName << "." << hex << hashText(srcString, hashText(key)) << ".bin";
+
+	ifstream cacheFile(cacheName.str().c_str(), ios::in | ios::binary);
+
+	if (cacheFile.is_open()) {
+
+		string binary((istreambuf_iterator<char>(cacheFile)), istreambuf_iterator<char>());
+		const unsigned char* binaryData = (const unsigned char*)binary.data();
+		size_t binarySize = binary.size();
+		cl_int binaryStatus = CL_SUCCESS, err = CL_SUCCESS;
+
+		cl_program program = binarySize ? clCreateProgramWithBinary(context, 1, &device, &binarySize, &binaryData, &binaryStatus, &err) : nullptr;
+
+		// A binary still has to be built, which is fast
+		if (program && binaryStatus == CL_SUCCESS && err == CL_SUCCESS && buildProgram(program, device, options) == CL_SUCCESS) {
+
+			if (fromCache)
+				*fromCache = true;
+			return program;
+		}
+
+		if (program && binaryStatus == CL_SUCCESS && err == CL_SUCCESS)
+			cout << "Cached binary " << cacheName.str() << " failed to build, rebuilding from source\n";
+		else if (program)
+			clReleaseProgram(program);
+	}
+
+	cl_program program = createProgramFromSource(context, device, srcString, options);
+
+	if (!program)
+		return nullptr;
+
+	size_t binarySize = 0;
+	clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, nullptr);
+
+	if (binarySize) {
+
+		vector<unsigned char> binary(binarySize);
+		unsigned char* binaryData = &binary[0];
+		clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binaryData, nullptr);
+
+		ofstream out(cacheName.str().c_str(), ios::out | ios::binary);
+		out.write((const char*)binaryData, binarySize);
+
+		if (!out)
+			cout << "Cannot write program cache " << cacheName.str() << endl;
 	}
 
 	return program;
 }
+
+
+// The tuning file has one line per device: the device key, a tab, and the local size x and y, pixels per item and vector stores (0 or 1).
+// A line with values julia_tuned_kernel cannot run, e.g. written by hand or by another version, is skipped
+bool loadTuning(const char* fileName, const string& key, ClKernelTuning& tuning) {
+
+	ifstream file(fileName);
+	string line;
+
+	while (getline(file, line)) {
+
+		size_t tab = line.rfind('\t');
+
+		if (tab == string::npos || line.compare(0, tab, key) != 0 || tab != key.size())
+			continue;
+
+		istringstream values(line.substr(tab + 1));
+		int vectorStores = 0;
+
+		if (values >> tuning.localSize[0] >> tuning.localSize[1] >> tuning.pixelsPerItem >> vectorStores && tuning.pixelsPerItem <= ClKernelTuning::maxPixelsPerItem
+			&& (tuning.localSize[0] > 0) == (tuning.localSize[1] > 0)) {
+
+			tuning.vectorStores = vectorStores != 0;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+bool saveTuning(const char* fileName, const string& key, const ClKernelTuning& tuning) {
+
+	vector<string> lines;
+	{
+		ifstream file(fileName);
+		string line;
+
+		while (getline(file, line)) {
+
+			if (line.compare(0, key.size() + 1, key + "\t") != 0)
+				lines.push_back(line);
+		}
+	}
+
+	ostringstream entry;
+	entry << key << '\t' << tuning.localSize[0] << ' ' << tuning.localSize[1] << ' ' << tuning.pixelsPerItem << ' ' << (tuning.vectorStores ? 1 : 0);
+	lines.push_back(entry.str());
+
+	ofstream file(fileName);
+
+	for (const string& line : lines)
+		file << line << '\n';
+
+	if (!file) {
+
+		cout << "Cannot write tuning file " << fileName << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Helper function to find every usable device of every platform
+vector<ClDevice> listDevices() {
+
+	vector<ClDevice> result;
+	cl_uint numPlatforms = 0;
+
+	if (clGetPlatformIDs(0, nullptr, &numPlatforms) != CL_SUCCESS || numPlatforms == 0) {
+
+		cout << "No OpenCL platforms found\n";
+		return result;
+	}
+
+	vector<cl_platform_id> platforms(numPlatforms);
+	clGetPlatformIDs(numPlatforms, &platforms[0], nullptr);
+
+	for (cl_uint i = 0; i < numPlatforms; ++i) {
+
+		cl_uint numDevices = 0;
+		if (clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, 0, nullptr, &numDevices) != CL_SUCCESS || numDevices == 0)
+			continue;
+
+		vector<cl_device_id> devices(numDevices);
+		clGetDeviceIDs(platforms[i], CL_DEVICE_TYPE_ALL, numDevices, &devices[0], nullptr);
+		string platformName = queryString(clGetPlatformInfo, platforms[i], (cl_platform_info)CL_PLATFORM_NAME);
+
+		for (cl_uint j = 0; j < numDevices; ++j) {
+
+			cl_bool available = CL_FALSE, compilerAvailable = CL_FALSE;
+			clGetDeviceInfo(devices[j], CL_DEVICE_AVAILABLE, sizeof(cl_bool), &available, nullptr);
+			clGetDeviceInfo(devices[j], CL_DEVICE_COMPILER_AVAILABLE, sizeof(cl_bool), &compilerAvailable, nullptr);
+			// julia.cl is built from source, so a device without compiler is of no use
+			if (!available || !compilerAvailable)
+				continue;
+
+			ClDevice device;
+			device.platform = platforms[i];
+			device.device = devices[j];
+			device.platformIndex = i;
+			device.deviceIndex = j;
+			device.platformName = platformName;
+			device.deviceName = queryString(clGetDeviceInfo, devices[j], (cl_device_info)CL_DEVICE_NAME);
+			device.type = 0;
+			device.computeUnits = 0;
+			clGetDeviceInfo(devices[j], CL_DEVICE_TYPE, sizeof(cl_device_type), &device.type, nullptr);
+			clGetDeviceInfo(devices[j], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &device.computeUnits, nullptr);
+			result.push_back(device);
+		}
+	}
+
+	return result;
+}
+
+
+void printDevices(const vector<ClDevice>& devices) {
+
+	for (const ClDevice& device : devices) {
+
+		const char* type = (device.type & CL_DEVICE_TYPE_GPU) ? "GPU" : (device.type & CL_DEVICE_TYPE_CPU) ? "CPU" : (device.type & CL_DEVICE_TYPE_ACCELERATOR) ? "accelerator" : "other";
+		cout << device.platformIndex << ":" << device.deviceIndex << " " << device.platformName << " / " << device.deviceName
+			<< " (" << type << ", " << device.computeUnits << " compute units)\n";
+	}
+}
+
+
+// Helper function to choose devices from a configurable spec, see setup_cl.h
+vector<ClDevice> selectDevices(const vector<ClDevice>& devices, const char* spec) {
+
+	vector<ClDevice> result;
+	vector<bool> selected(devices.size(), false);
+
+	string terms = spec ? spec : "";
+	if (terms.find_first_not_of(" ,") == string::npos) {
+
+		for (size_t i = 0; i < devices.size(); ++i)
+			selected[i] = (devices[i].type & CL_DEVICE_TYPE_GPU) != 0;
+		if (find(selected.begin(), selected.end(), true) == selected.end())
+			selected.assign(devices.size(), true);
+	}
+
+	istringstream list(terms);
+	string term;
+	while (getline(list, term, ',')) {
+
+		// Trim spaces
+		size_t first = term.find_first_not_of(' ');
+		if (first == string::npos)
+			continue;
+		term = toUpper(term.substr(first, term.find_last_not_of(' ') - first + 1));
+
+		unsigned int platformIndex = 0, deviceIndex = 0;
+		char separator = 0;
+		istringstream indices(term);
+		bool byIndex = (indices >> platformIndex >> separator >> deviceIndex) && separator == ':' && (indices >> ws).eof();
+		cl_device_type type = term == "ALL" ? CL_DEVICE_TYPE_ALL : term == "GPU" ? CL_DEVICE_TYPE_GPU : term == "CPU" ? CL_DEVICE_TYPE_CPU : term == "ACCELERATOR" ? CL_DEVICE_TYPE_ACCELERATOR : 0;
+
+		bool matched = false;
+		for (size_t i = 0; i < devices.size(); ++i) {
+
+			const ClDevice& device = devices[i];
+			bool match;
+			if (byIndex)
+				match = device.platformIndex == platformIndex && device.deviceIndex == deviceIndex;
+			else if (type)
+				match = (device.type & type) != 0;
+			else
+				match = toUpper(device.platformName).find(term) != string::npos || toUpper(device.deviceName).find(term) != string::npos;
+
+			selected[i] = selected[i] || match;
+			matched = matched || match;
+		}
+
+		if (!matched)
+			cout << "No OpenCL device matches '" << term << "'\n";
+	}
+
+	for (size_t i = 0; i < devices.size(); ++i) {
+
+		if (selected[i])
+			result.push_back(devices[i]);
+	}
+
+	return result;
+}
+
+
+// Helper function to create a context for one device of listDevices
+cl_context createContextForDevice(const ClDevice& device) {
+
+	cl_context_properties contextProperties[] = {
+
+		CL_CONTEXT_PLATFORM,
+		(cl_context_properties)device.platform,
+		0
+	};
+
+	cl_int err = 0;
+	cl_context context = clCreateContext(contextProperties, 1, &device.device, nullptr, nullptr, &err);
+
+	if (!context)
+		cout << "Unable to create a context for " << device.deviceName << ", ErrorCode:" << err << endl;
+
+	return context;
+}
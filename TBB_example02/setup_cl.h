@@ -2,7 +2,9 @@
 
 #pragma once
 
-#include <CL\opencl.h>
+#include <string>
+#include <vector>
+#include <CL/opencl.h>
 
 cl_context createContext(const char* platform);
 
@@ -10,4 +12,55 @@ cl_device_id getDeviceForContext(cl_context context, int deviceIndex = 0);
 
 cl_command_queue createCommandQueue(cl_context context, cl_device_id *device);
 
-cl_program createProgram(cl_context context, cl_device_id device, const char* fileName);
+cl_program createProgram(cl_context context, cl_device_id device, const char* fileName, const char* options = nullptr);
+
+// createProgram through a cache of program binaries on disk, keyed by device, driver version, options and source. *fromCache tells whether the cache was used
+cl_program createProgramCached(cl_context context, cl_device_id device, const char* fileName, const char* options = nullptr, bool* fromCache = nullptr);
+
+// Platform, device, driver and OpenCL version of device: what a program binary or a tuning is only valid for
+std::string deviceKey(cl_device_id device);
+
+// Launch configuration of a kernel found by measuring it on one device, see OpenCLJulia::autotune
+struct ClKernelTuning {
+	// Work group size, { 0, 0 } leaves it to the implementation
+	size_t localSize[2];
+	// Neighbouring pixels of a row rendered by one work item, at most maxPixelsPerItem. 0 when julia_kernel was faster than every configuration
+	unsigned int pixelsPerItem;
+	// Pixels written with vector stores instead of one byte at a time
+	bool vectorStores;
+
+	// TUNED_MAX_PIXELS of julia_tuned_kernel
+	static const unsigned int maxPixelsPerItem = 8;
+};
+
+// The tuning stored for key (see deviceKey) in fileName. Returns false when the file has none, or only an invalid one
+bool loadTuning(const char* fileName, const std::string& key, ClKernelTuning& tuning);
+
+// Stores tuning for key in fileName, replacing an earlier tuning for key and keeping those of other devices. Returns false when the file could not be written
+bool saveTuning(const char* fileName, const std::string& key, const ClKernelTuning& tuning);
+
+// An OpenCL device of one of the platforms, as found by listDevices
+struct ClDevice {
+	cl_platform_id platform;
+	cl_device_id device;
+	cl_device_type type;
+	// Position of the platform in clGetPlatformIDs and of the device in its platform
+	unsigned int platformIndex, deviceIndex;
+	std::string platformName, deviceName;
+	cl_uint computeUnits;
+};
+
+// Every available device with a compiler, of every platform
+std::vector<ClDevice> listDevices();
+
+void printDevices(const std::vector<ClDevice>& devices);
+
+// The devices chosen by spec, a comma separated list of terms. Every term adds the devices it matches:
+//   all, gpu, cpu or accelerator    every device of that type
+//   <platform index>:<device index> one device, numbered as by printDevices
+//   anything else                   every device whose platform or device name contains it, case insensitive
+// An empty or null spec selects the GPUs, or every device when there is no GPU.
+std::vector<ClDevice> selectDevices(const std::vector<ClDevice>& devices, const char* spec);
+
+// Context holding only the given device
+cl_context createContextForDevice(const ClDevice& device);
@@ -0,0 +1,265 @@
+
+//
+// Vectorised Julia kernels (SSE2, AVX2 and AVX-512) and runtime selection of the instruction set
+//
+
+
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "simd_julia.h"
+
+
+using namespace std;
+
+
+// MSVC accepts every intrinsic in every function, gcc and clang need to be told which instruction set a function may use.
+// Contraction to FMA is disabled because the result has to stay bit identical to the scalar kernel.
+#ifdef _MSC_VER
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+
+
+SimdLevel detectSimdLevel() {
+
+#ifdef _MSC_VER
+	int info[4];
+
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+
+	// The operating system has to save the ymm (bits 1-2) and zmm (bits 5-7) registers on a context switch
+	unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+	bool ymmState = avx && (xcr0 & 0x06) == 0x06;
+	bool zmmState = ymmState && (xcr0 & 0xE0) == 0xE0;
+
+	bool avx2 = false, avx512 = false;
+	if (maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		avx2 = ymmState && (info[1] & (1 << 5)) != 0;
+		avx512 = zmmState && (info[1] & (1 << 16)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool sse2 = __builtin_cpu_supports("sse2") != 0;
+	bool avx2 = __builtin_cpu_supports("avx2") != 0;
+	bool avx512 = __builtin_cpu_supports("avx512f") != 0;
+#endif
+
+	if (avx512) return SIMD_AVX512;
+	if (avx2) return SIMD_AVX2;
+	if (sse2) return SIMD_SSE2;
+	return SIMD_SCALAR;
+}
+
+
+unsigned int simdLaneCount(SimdLevel level) {
+
+	switch (level) {
+	case SIMD_AVX512: return 16;
+	case SIMD_AVX2: return 8;
+	case SIMD_SSE2: return 4;
+	default: return 1;
+	}
+}
+
+
+const char* simdLevelName(SimdLevel level) {
+
+	switch (level) {
+	case SIMD_AVX512: return "AVX-512";
+	case SIMD_AVX2: return "AVX2";
+	case SIMD_SSE2: return "SSE2";
+	default: return "scalar";
+	}
+}
+
+
+// Every kernel performs exactly the same float operations, in the same order, as JuliaGenerator::cppKernel:
+// Z = (x*x - y*y + Cr, (x*y + y*x) + Ci) followed by the escape test x*x + y*y > 4.
+// A lane that escapes is masked off and stops counting; the loop ends as soon as every lane has escaped.
+// With the periodicity check a lane whose Z is within the tolerance of the saved Z is masked off too and gets max_iterations.
+// Z is saved after 1, 2, 4, 8, ... iterations (Brent), the same iterations for every lane.
+
+static void escapeCountsScalar(const float* zx, float zy, complex<float> C, unsigned int max_iterations, unsigned int* counts, float tolerance) {
+
+	complex<float> Z(zx[0], zy);
+	complex<float> saved = Z;
+	unsigned int checkLength = 1, period = 0;
+	unsigned int i;
+	for (i = 0; i < max_iterations; i++) {
+		Z = Z * Z + C;
+		if (norm(Z) > 4.0f) break;
+		if (tolerance > 0.0f) {
+			if (fabs(Z.real() - saved.real()) < tolerance && fabs(Z.imag() - saved.imag()) < tolerance) {
+				i = max_iterations;
+				break;
+			}
+			if (++period == checkLength) {
+				period = 0;
+				checkLength *= 2;
+				saved = Z;
+			}
+		}
+	}
+	counts[0] = i;
+}
+
+
+SIMD_TARGET("sse2")
+static void escapeCountsSSE2(const float* zx, float zy, complex<float> C, unsigned int max_iterations, unsigned int* counts, float tolerance) {
+
+	const __m128 cr = _mm_set1_ps(C.real());
+	const __m128 ci = _mm_set1_ps(C.imag());
+	const __m128 four = _mm_set1_ps(4.0f);
+	const __m128 tol = _mm_set1_ps(tolerance);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+
+	__m128 x = _mm_loadu_ps(zx);
+	__m128 y = _mm_set1_ps(zy);
+	__m128 active = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	__m128 periodic = _mm_setzero_ps();
+	__m128i count = _mm_setzero_si128();
+	__m128 savedX = x, savedY = y;
+	unsigned int checkLength = 1, period = 0;
+
+	for (unsigned int i = 0; i < max_iterations; i++) {
+		__m128 xy = _mm_mul_ps(x, y);
+		x = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), cr);
+		y = _mm_add_ps(_mm_add_ps(xy, xy), ci);
+
+		__m128 magnitude = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+		active = _mm_andnot_ps(_mm_cmpgt_ps(magnitude, four), active);
+		if (tolerance > 0.0f) {
+			__m128 same = _mm_and_ps(
+				_mm_cmplt_ps(_mm_andnot_ps(signBit, _mm_sub_ps(x, savedX)), tol),
+				_mm_cmplt_ps(_mm_andnot_ps(signBit, _mm_sub_ps(y, savedY)), tol));
+			same = _mm_and_ps(same, active);
+			periodic = _mm_or_ps(periodic, same);
+			active = _mm_andnot_ps(same, active);
+			if (++period == checkLength) {
+				period = 0;
+				checkLength *= 2;
+				savedX = x;
+				savedY = y;
+			}
+		}
+		if (_mm_movemask_ps(active) == 0) break;
+		// active lanes are all ones (-1), so subtracting the mask counts one iteration
+		count = _mm_sub_epi32(count, _mm_castps_si128(active));
+	}
+	// count = periodic ? max_iterations : count
+	__m128i periodicMask = _mm_castps_si128(periodic);
+	count = _mm_or_si128(_mm_andnot_si128(periodicMask, count), _mm_and_si128(periodicMask, _mm_set1_epi32((int)max_iterations)));
+	_mm_storeu_si128((__m128i*)counts, count);
+}
+
+
+SIMD_TARGET("avx2")
+static void escapeCountsAVX2(const float* zx, float zy, complex<float> C, unsigned int max_iterations, unsigned int* counts, float tolerance) {
+
+	const __m256 cr = _mm256_set1_ps(C.real());
+	const __m256 ci = _mm256_set1_ps(C.imag());
+	const __m256 four = _mm256_set1_ps(4.0f);
+	const __m256 tol = _mm256_set1_ps(tolerance);
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+	__m256 x = _mm256_loadu_ps(zx);
+	__m256 y = _mm256_set1_ps(zy);
+	__m256 active = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+	__m256 periodic = _mm256_setzero_ps();
+	__m256i count = _mm256_setzero_si256();
+	__m256 savedX = x, savedY = y;
+	unsigned int checkLength = 1, period = 0;
+
+	for (unsigned int i = 0; i < max_iterations; i++) {
+		__m256 xy = _mm256_mul_ps(x, y);
+		x = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), cr);
+		y = _mm256_add_ps(_mm256_add_ps(xy, xy), ci);
+
+		__m256 magnitude = _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+		active = _mm256_andnot_ps(_mm256_cmp_ps(magnitude, four, _CMP_GT_OQ), active);
+		if (tolerance > 0.0f) {
+			__m256 same = _mm256_and_ps(
+				_mm256_cmp_ps(_mm256_andnot_ps(signBit, _mm256_sub_ps(x, savedX)), tol, _CMP_LT_OQ),
+				_mm256_cmp_ps(_mm256_andnot_ps(signBit, _mm256_sub_ps(y, savedY)), tol, _CMP_LT_OQ));
+			same = _mm256_and_ps(same, active);
+			periodic = _mm256_or_ps(periodic, same);
+			active = _mm256_andnot_ps(same, active);
+			if (++period == checkLength) {
+				period = 0;
+				checkLength *= 2;
+				savedX = x;
+				savedY = y;
+			}
+		}
+		if (_mm256_movemask_ps(active) == 0) break;
+		count = _mm256_sub_epi32(count, _mm256_castps_si256(active));
+	}
+	count = _mm256_blendv_epi8(count, _mm256_set1_epi32((int)max_iterations), _mm256_castps_si256(periodic));
+	_mm256_storeu_si256((__m256i*)counts, count);
+}
+
+
+SIMD_TARGET("avx512f")
+static void escapeCountsAVX512(const float* zx, float zy, complex<float> C, unsigned int max_iterations, unsigned int* counts, float tolerance) {
+
+	const __m512 cr = _mm512_set1_ps(C.real());
+	const __m512 ci = _mm512_set1_ps(C.imag());
+	const __m512 four = _mm512_set1_ps(4.0f);
+	const __m512 tol = _mm512_set1_ps(tolerance);
+	const __m512i one = _mm512_set1_epi32(1);
+
+	__m512 x = _mm512_loadu_ps(zx);
+	__m512 y = _mm512_set1_ps(zy);
+	__mmask16 active = 0xFFFF;
+	__mmask16 periodic = 0;
+	__m512i count = _mm512_setzero_si512();
+	__m512 savedX = x, savedY = y;
+	unsigned int checkLength = 1, period = 0;
+
+	for (unsigned int i = 0; i < max_iterations; i++) {
+		__m512 xy = _mm512_mul_ps(x, y);
+		x = _mm512_add_ps(_mm512_sub_ps(_mm512_mul_ps(x, x), _mm512_mul_ps(y, y)), cr);
+		y = _mm512_add_ps(_mm512_add_ps(xy, xy), ci);
+
+		__m512 magnitude = _mm512_add_ps(_mm512_mul_ps(x, x), _mm512_mul_ps(y, y));
+		active &= ~_mm512_cmp_ps_mask(magnitude, four, _CMP_GT_OQ);
+		if (tolerance > 0.0f) {
+			__mmask16 same = active
+				& _mm512_cmp_ps_mask(_mm512_abs_ps(_mm512_sub_ps(x, savedX)), tol, _CMP_LT_OQ)
+				& _mm512_cmp_ps_mask(_mm512_abs_ps(_mm512_sub_ps(y, savedY)), tol, _CMP_LT_OQ);
+			periodic |= same;
+			active &= ~same;
+			if (++period == checkLength) {
+				period = 0;
+				checkLength *= 2;
+				savedX = x;
+				savedY = y;
+			}
+		}
+		if (active == 0) break;
+		count = _mm512_mask_add_epi32(count, active, count, one);
+	}
+	count = _mm512_mask_mov_epi32(count, periodic, _mm512_set1_epi32((int)max_iterations));
+	_mm512_storeu_si512(counts, count);
+}
+
+
+void simdEscapeCounts(SimdLevel level, const float* zx, float zy, complex<float> C, unsigned int max_iterations, unsigned int* counts, float periodicityTolerance) {
+
+	switch (level) {
+	case SIMD_AVX512: escapeCountsAVX512(zx, zy, C, max_iterations, counts, periodicityTolerance); break;
+	case SIMD_AVX2: escapeCountsAVX2(zx, zy, C, max_iterations, counts, periodicityTolerance); break;
+	case SIMD_SSE2: escapeCountsSSE2(zx, zy, C, max_iterations, counts, periodicityTolerance); break;
+	default: escapeCountsScalar(zx, zy, C, max_iterations, counts, periodicityTolerance); break;
+	}
+}
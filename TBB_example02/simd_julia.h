@@ -0,0 +1,20 @@
+#pragma once
+
+#include <complex>
+
+// Instruction sets supported by the vectorised Julia kernels, ordered from slowest to fastest
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2, SIMD_AVX512 };
+
+// Returns the widest instruction set supported by both the CPU and the operating system
+SimdLevel detectSimdLevel();
+
+// Number of pixels iterated together by the kernel of the given instruction set
+unsigned int simdLaneCount(SimdLevel level);
+
+// Human readable name of the instruction set
+const char* simdLevelName(SimdLevel level);
+
+// Iterates simdLaneCount(level) pixels of one row at once. zx holds the real part of every pixel, zy is the imaginary part shared by the row.
+// counts receives the iteration on which every pixel escaped, or max_iterations when it did not escape.
+// A periodicityTolerance above 0 enables the Brent cycle check of JuliaGenerator::escapeTime: pixels whose orbit repeats within the tolerance get max_iterations.
+void simdEscapeCounts(SimdLevel level, const float* zx, float zy, std::complex<float> C, unsigned int max_iterations, unsigned int* counts, float periodicityTolerance = 0.0f);
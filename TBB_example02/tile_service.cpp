@@ -0,0 +1,198 @@
+
+//
+// Minimal HTTP server for the tile service
+//
+
+
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <direct.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+#include "tile_service.h"
+
+
+using namespace std;
+
+
+#ifdef _WIN32
+static void closeSocket(uintptr_t socket) { closesocket((SOCKET)socket); }
+static const uintptr_t invalidSocket = (uintptr_t)INVALID_SOCKET;
+static const int sendFlags = 0;
+#else
+static void closeSocket(int socket) { close(socket); }
+static const int invalidSocket = -1;
+// A client that hangs up must not kill the process with SIGPIPE
+static const int sendFlags = MSG_NOSIGNAL;
+#endif
+
+// Requests with a larger header are refused
+static const size_t maxRequestBytes = 8192;
+
+
+static const char* statusText(int status) {
+
+	switch (status) {
+	case 200: return "OK";
+	case 400: return "Bad Request";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	default: return "Internal Server Error";
+	}
+}
+
+
+HttpServer::HttpServer(unsigned short port, Handler handler, unsigned int threads)
+	: handler(handler), listener(invalidSocket), listening(false), socketsStarted(false), stopping(false) {
+
+#ifdef _WIN32
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+		cout << "Cannot initialise Winsock\n";
+		return;
+	}
+	socketsStarted = true;
+#endif
+
+	listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == invalidSocket) {
+		cout << "Cannot create socket\n";
+		return;
+	}
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	// Only local clients: the service is not meant to be exposed
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (::bind(listener, (const sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0) {
+		cout << "Cannot listen on port " << port << endl;
+		closeSocket(listener);
+		listener = invalidSocket;
+		return;
+	}
+	listening = true;
+
+	for (unsigned int i = 0; i < threads; i++) {
+		workers.push_back(thread([this]() { acceptConnections(); }));
+	}
+}
+
+
+HttpServer::~HttpServer() {
+
+	stop();
+#ifdef _WIN32
+	if (socketsStarted) WSACleanup();
+#endif
+}
+
+
+bool HttpServer::isValid() const {
+
+	return listening;
+}
+
+
+void HttpServer::stop() {
+
+	if (stopping.exchange(true)) return;
+	if (listener != invalidSocket) {
+		// Wakes up the threads blocked in accept
+#ifdef _WIN32
+		shutdown(listener, SD_BOTH);
+#else
+		shutdown(listener, SHUT_RDWR);
+#endif
+		closeSocket(listener);
+	}
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	workers.clear();
+	listening = false;
+}
+
+
+void HttpServer::acceptConnections() {
+
+	while (!stopping) {
+		Socket connection = accept(listener, nullptr, nullptr);
+		if (connection == invalidSocket) {
+			if (stopping) break;
+			continue;
+		}
+		handleConnection(connection);
+		closeSocket(connection);
+	}
+}
+
+
+void HttpServer::handleConnection(Socket connection) {
+
+	// The request line and headers end with an empty line, a GET request has no body
+	string request;
+	char buffer[1024];
+	while (request.find("\r\n\r\n") == string::npos && request.size() < maxRequestBytes) {
+		int received = recv(connection, buffer, sizeof(buffer), 0);
+		if (received <= 0) return;
+		request.append(buffer, received);
+	}
+
+	istringstream requestLine(request.substr(0, request.find("\r\n")));
+	string method, target, version;
+	requestLine >> method >> target >> version;
+
+	HttpResponse response;
+	if (request.size() >= maxRequestBytes || target.empty()) {
+		response.status = 400;
+	}
+	else if (method != "GET") {
+		response.status = 405;
+	}
+	else {
+		response = handler(target);
+	}
+	if (response.status != 200 && response.body.empty()) {
+		string text = statusText(response.status);
+		response.contentType = "text/plain";
+		response.body.assign(text.begin(), text.end());
+	}
+
+	ostringstream header;
+	header << "HTTP/1.0 " << response.status << " " << statusText(response.status) << "\r\n"
+		<< "Content-Type: " << response.contentType << "\r\n"
+		<< "Content-Length: " << response.body.size() << "\r\n"
+		<< "Connection: close\r\n\r\n";
+	string text = header.str();
+	vector<unsigned char> answer(text.begin(), text.end());
+	answer.insert(answer.end(), response.body.begin(), response.body.end());
+
+	size_t sent = 0;
+	while (sent < answer.size()) {
+		int result = send(connection, (const char*)&answer[sent], (int)(answer.size() - sent), sendFlags);
+		if (result <= 0) return;
+		sent += result;
+	}
+}
+
+
+bool createDirectory(const char* name) {
+
+#ifdef _WIN32
+	if (_mkdir(name) == 0) return true;
+#else
+	if (mkdir(name, 0755) == 0) return true;
+#endif
+	struct stat info;
+	return stat(name, &info) == 0 && (info.st_mode & S_IFDIR) != 0;
+}
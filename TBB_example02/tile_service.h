@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+// Answer to one request
+struct HttpResponse {
+	int status;
+	std::string contentType;
+	std::vector<unsigned char> body;
+};
+
+// Minimal HTTP/1.0 server on the loopback interface, for GET requests only. Every connection carries one request and is closed after the answer.
+// A fixed number of threads accept connections, so that many requests are handled at the same time.
+class HttpServer {
+public:
+	// Called with the request target, e.g. "/tile/3/2/5.png?max=500", from several threads at once
+	typedef std::function<HttpResponse(const std::string& target)> Handler;
+
+	HttpServer(unsigned short port, Handler handler, unsigned int threads = 4);
+	~HttpServer();
+
+	// false when the port could not be opened
+	bool isValid() const;
+
+	// Stops accepting connections and waits for the requests being handled. Called by the destructor if needed
+	void stop();
+
+private:
+	HttpServer(const HttpServer&);
+	HttpServer& operator=(const HttpServer&);
+
+#ifdef _WIN32
+	typedef uintptr_t Socket;
+#else
+	typedef int Socket;
+#endif
+
+	void acceptConnections();
+	void handleConnection(Socket connection);
+
+	Handler handler;
+	Socket listener;
+	bool listening;
+	// WSAStartup succeeded, so the destructor has to call WSACleanup. Always false outside Windows
+	bool socketsStarted;
+	std::atomic<bool> stopping;
+	std::vector<std::thread> workers;
+};
+
+// Creates the directory when it does not exist yet. Returns false when it does not exist afterwards
+bool createDirectory(const char* name);
@@ -0,0 +1,297 @@
+
+//
+// Recording and exporting the spans of the instrumented hot paths. Empty unless JULIA_TRACE is defined
+//
+
+
+#include "trace.h"
+
+#ifdef JULIA_TRACE
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include "png_writer.h"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+
+using namespace std;
+using namespace std::chrono;
+
+
+// Spans of one thread, only touched by that thread while recording
+struct ThreadTrace {
+	vector<TraceEvent> events;
+	unsigned int lane;
+	// perf_event file descriptors, -1 when not open
+	int cyclesCounter, instructionsCounter;
+	bool countersOpened;
+};
+
+static mutex traceMutex;
+static vector<unique_ptr<ThreadTrace>> threadTraces;
+// Name of every lane, lane 0 is unused
+static vector<string> laneNames(1);
+static atomic<bool> recording(false);
+static atomic<bool> countersEnabled(false);
+static steady_clock::time_point origin = steady_clock::now();
+static thread_local ThreadTrace* currentThread = nullptr;
+
+
+static ThreadTrace& threadTrace() {
+
+	if (!currentThread) {
+		lock_guard<mutex> lock(traceMutex);
+		threadTraces.push_back(unique_ptr<ThreadTrace>(new ThreadTrace()));
+		currentThread = threadTraces.back().get();
+		currentThread->lane = (unsigned int)laneNames.size();
+		currentThread->cyclesCounter = -1;
+		currentThread->instructionsCounter = -1;
+		currentThread->countersOpened = false;
+		laneNames.push_back("thread " + to_string(threadTraces.size()));
+	}
+	return *currentThread;
+}
+
+
+#ifdef __linux__
+// Counter of the calling thread on any CPU, counting user space only
+static int openCounter(unsigned long long config) {
+
+	perf_event_attr attributes;
+	memset(&attributes, 0, sizeof(attributes));
+	attributes.type = PERF_TYPE_HARDWARE;
+	attributes.size = sizeof(attributes);
+	attributes.config = config;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv = 1;
+	return (int)syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+static int64_t readCounter(int counter) {
+
+	uint64_t value;
+	if (counter < 0 || read(counter, &value, sizeof(value)) != sizeof(value)) return -1;
+	return (int64_t)value;
+}
+#endif
+
+
+static void openCounters(ThreadTrace& thread) {
+
+	thread.countersOpened = true;
+#ifdef __linux__
+	thread.cyclesCounter = openCounter(PERF_COUNT_HW_CPU_CYCLES);
+	thread.instructionsCounter = openCounter(PERF_COUNT_HW_INSTRUCTIONS);
+#endif
+}
+
+
+void traceStart() {
+
+	lock_guard<mutex> lock(traceMutex);
+	for (unique_ptr<ThreadTrace>& thread : threadTraces) {
+		thread->events.clear();
+	}
+	origin = steady_clock::now();
+	recording = true;
+}
+
+
+void traceStop() {
+
+	recording = false;
+}
+
+
+bool traceEnabled() {
+
+	return recording;
+}
+
+
+int64_t traceNow() {
+
+	return duration_cast<nanoseconds>(steady_clock::now() - origin).count();
+}
+
+
+bool traceEnableHardwareCounters() {
+
+	ThreadTrace& thread = threadTrace();
+	if (!thread.countersOpened) openCounters(thread);
+	countersEnabled = thread.cyclesCounter >= 0 && thread.instructionsCounter >= 0;
+	if (!countersEnabled) cout << "Hardware counters are not available\n";
+	return countersEnabled;
+}
+
+
+void traceReadCounters(int64_t& cycles, int64_t& instructions) {
+
+	cycles = -1;
+	instructions = -1;
+	if (!countersEnabled) return;
+	ThreadTrace& thread = threadTrace();
+	if (!thread.countersOpened) openCounters(thread);
+#ifdef __linux__
+	cycles = readCounter(thread.cyclesCounter);
+	instructions = readCounter(thread.instructionsCounter);
+#endif
+}
+
+
+unsigned int traceLane(const string& name) {
+
+	lock_guard<mutex> lock(traceMutex);
+	vector<string>::iterator lane = find(laneNames.begin() + 1, laneNames.end(), name);
+	if (lane != laneNames.end()) return (unsigned int)(lane - laneNames.begin());
+	laneNames.push_back(name);
+	return (unsigned int)laneNames.size() - 1;
+}
+
+
+void traceRecord(const TraceEvent& event) {
+
+	if (!recording) return;
+	ThreadTrace& thread = threadTrace();
+	thread.events.push_back(event);
+	if (event.lane == 0) thread.events.back().lane = thread.lane;
+}
+
+
+void traceSpan(const char* name, int64_t startNs) {
+
+	if (!recording) return;
+	TraceEvent event = { name, "cpu", startNs, traceNow() - startNs, 0, 0, 0, 0, 0, -1.0, -1, -1 };
+	traceRecord(event);
+}
+
+
+TraceScope::TraceScope(const char* name, const char* category) : active(recording) {
+
+	if (!active) return;
+	event.name = name;
+	event.category = category;
+	event.lane = 0;
+	event.x = event.y = event.width = event.height = 0;
+	event.iterations = -1;
+	traceReadCounters(event.cycles, event.instructions);
+	event.startNs = traceNow();
+}
+
+
+TraceScope::~TraceScope() {
+
+	if (!active) return;
+	event.durationNs = traceNow() - event.startNs;
+	if (event.cycles >= 0) {
+		int64_t cycles, instructions;
+		traceReadCounters(cycles, instructions);
+		event.cycles = cycles - event.cycles;
+		event.instructions = instructions - event.instructions;
+	}
+	traceRecord(event);
+}
+
+
+void TraceScope::tile(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+
+	event.x = x;
+	event.y = y;
+	event.width = width;
+	event.height = height;
+}
+
+
+void TraceScope::iterations(double iterations) {
+
+	event.iterations = iterations;
+}
+
+
+bool writeChromeTrace(const char* fileName) {
+
+	ofstream file(fileName);
+	if (!file.is_open()) {
+		cout << "Cannot create file " << fileName << endl;
+		return false;
+	}
+	lock_guard<mutex> lock(traceMutex);
+	file << fixed << setprecision(3) << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+	// Chrome traces count in microseconds
+	for (size_t lane = 1; lane < laneNames.size(); lane++) {
+		file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << lane << ", \"args\": {\"name\": \"" << laneNames[lane] << "\"}},\n";
+	}
+	size_t written = 0;
+	for (const unique_ptr<ThreadTrace>& thread : threadTraces) {
+		for (const TraceEvent& event : thread->events) {
+			file << (written++ ? ",\n" : "") << "{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.lane
+				<< ", \"ts\": " << event.startNs / 1000.0 << ", \"dur\": " << event.durationNs / 1000.0 << ", \"args\": {";
+			const char* separator = "";
+			if (event.width > 0) {
+				file << "\"x\": " << event.x << ", \"y\": " << event.y << ", \"width\": " << event.width << ", \"height\": " << event.height;
+				separator = ", ";
+			}
+			if (event.iterations >= 0.0) {
+				file << separator << "\"iterations\": " << setprecision(0) << event.iterations << setprecision(3);
+				separator = ", ";
+			}
+			if (event.cycles >= 0) {
+				file << separator << "\"cycles\": " << event.cycles << ", \"instructions\": " << event.instructions;
+			}
+			file << "}}";
+		}
+	}
+	file << "\n]}\n";
+	return file.good();
+}
+
+
+bool writeIterationHeatmap(const char* fileName, unsigned int size) {
+
+	vector<float> heat((size_t)size * size, 0.0f);
+	{
+		lock_guard<mutex> lock(traceMutex);
+		for (const unique_ptr<ThreadTrace>& thread : threadTraces) {
+			for (const TraceEvent& event : thread->events) {
+				if (event.width == 0 || event.height == 0 || event.iterations < 0.0) continue;
+				const float perPixel = (float)(event.iterations / ((double)event.width * event.height));
+				for (unsigned int y = event.y; y < min(size, event.y + event.height); y++) {
+					for (unsigned int x = event.x; x < min(size, event.x + event.width); x++) {
+						heat[(size_t)y * size + x] += perPixel;
+					}
+				}
+			}
+		}
+	}
+	const float hottest = *max_element(heat.begin(), heat.end());
+
+	PngWriter png(fileName, size, size);
+	if (!png.isValid()) return false;
+	vector<unsigned char> row(size * 3);
+	// Rows of the image buffers are bottom-up, PNG is top-down. Black, red, yellow, white on a logarithmic scale
+	for (unsigned int y = size; y-- > 0;) {
+		for (unsigned int x = 0; x < size; x++) {
+			const float value = hottest > 0.0f ? log1p(heat[(size_t)y * size + x]) / log1p(hottest) : 0.0f;
+			row[3 * x + 2] = (unsigned char)(255.0f * min(1.0f, max(0.0f, 3.0f * value)));
+			row[3 * x + 1] = (unsigned char)(255.0f * min(1.0f, max(0.0f, 3.0f * value - 1.0f)));
+			row[3 * x] = (unsigned char)(255.0f * min(1.0f, max(0.0f, 3.0f * value - 2.0f)));
+		}
+		png.writeRow(&row[0]);
+	}
+	return png.close();
+}
+
+#endif
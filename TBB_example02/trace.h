@@ -0,0 +1,88 @@
+#pragma once
+
+// Instrumentation of the hot paths, compiled in only when JULIA_TRACE is defined (/D JULIA_TRACE, -DJULIA_TRACE).
+// Without it the TRACE_ macros expand to nothing, trace.cpp is empty and the generators run exactly as before.
+//
+// Every thread records its spans in its own buffer, so recording takes no lock. Recording starts with traceStart
+// and the spans are exported with writeChromeTrace (chrome://tracing, ui.perfetto.dev) and writeIterationHeatmap.
+
+#ifdef JULIA_TRACE
+
+#include <cstdint>
+#include <string>
+
+// One span on a thread or on a lane (see traceLane). Times in nanoseconds since traceStart, on the steady clock of the host
+struct TraceEvent {
+	// Static strings
+	const char* name;
+	const char* category;
+	int64_t startNs, durationNs;
+	// Set by traceRecord when 0: the lane of the recording thread
+	unsigned int lane;
+	// Pixels of the image the span rendered, width 0 when the span is not a tile
+	unsigned int x, y, width, height;
+	// Escape time iterations spent in the span, -1 when not counted
+	double iterations;
+	// Hardware counters of the thread during the span, -1 when not measured (see traceEnableHardwareCounters)
+	int64_t cycles, instructions;
+};
+
+// Clears the recorded spans and starts recording. Call it while no generator is running
+void traceStart();
+// Stops recording, the spans are kept for the exports
+void traceStop();
+bool traceEnabled();
+// Nanoseconds since traceStart
+int64_t traceNow();
+
+// Opens the cycle and instruction counters (perf_event_open, Linux only) for every thread that records spans from now on.
+// Returns false when they are not available, e.g. on Windows or when perf_event_paranoid forbids them
+bool traceEnableHardwareCounters();
+// Counters of the calling thread, -1 when not available
+void traceReadCounters(int64_t& cycles, int64_t& instructions);
+
+// Lane for spans that do not run on a host thread, e.g. the kernels of an OpenCL device. The same name gives the same lane
+unsigned int traceLane(const std::string& name);
+// Adds a span to the buffer of the calling thread. Does nothing when not recording
+void traceRecord(const TraceEvent& event);
+// Records the span from startNs (a traceNow) until now on the calling thread
+void traceSpan(const char* name, int64_t startNs);
+
+// Writes the spans as a Chrome trace (JSON with "X" events, one track per thread and lane). Returns false when the file could not be written
+bool writeChromeTrace(const char* fileName);
+// Writes a size x size PNG of the iterations per pixel of the tiles, so the expensive parts of the image light up.
+// Meant for the spans of one image: tiles recorded more than once add up. Returns false when the file could not be written
+bool writeIterationHeatmap(const char* fileName, unsigned int size);
+
+// Records the span of its own lifetime on the calling thread, with the tile and iterations set in between
+class TraceScope {
+public:
+	TraceScope(const char* name, const char* category = "cpu");
+	~TraceScope();
+
+	void tile(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+	void iterations(double iterations);
+
+private:
+	TraceScope(const TraceScope&);
+	TraceScope& operator=(const TraceScope&);
+
+	TraceEvent event;
+	bool active;
+};
+
+#define TRACE_SCOPE(scope, name) TraceScope scope(name)
+#define TRACE_TILE(scope, x, y, width, height) scope.tile(x, y, width, height)
+#define TRACE_ITERATIONS(scope, count) scope.iterations(count)
+#define TRACE_MARK(mark) const int64_t mark = traceNow()
+#define TRACE_SPAN(name, mark) traceSpan(name, mark)
+
+#else
+
+#define TRACE_SCOPE(scope, name)
+#define TRACE_TILE(scope, x, y, width, height)
+#define TRACE_ITERATIONS(scope, count)
+#define TRACE_MARK(mark)
+#define TRACE_SPAN(name, mark)
+
+#endif